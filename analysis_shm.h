@@ -0,0 +1,211 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+// Analysis frames published into a POSIX shared memory ring, so other local processes (LED controllers, a
+// second renderer) get the same spectrum without redoing the analysis. The writer fills slot after slot and
+// never waits for anyone. Every slot has a sequence counter that is odd while the slot is being written
+// (a seqlock): a reader notes the counter, uses the data right in the mapping and checks the counter again
+// afterwards. If it changed, the writer lapped the reader and it has to retry with a newer frame. Any number
+// of readers can do this at the same time, they never write to the segment.
+// This header is both sides, the reader part doesn't need raylib (see examples/shm_reader.c).
+// NOTE: Not available on Windows, the functions just fail there.
+
+#define ANALYSIS_SHM_NAME "/cshadersound" // Default name of the segment
+#define ANALYSIS_SHM_MAGIC 0x43535348u    // "CSSH"
+#define ANALYSIS_SHM_VERSION 1
+#define ANALYSIS_SHM_SLOTS 8
+#define ANALYSIS_SHM_BINS 2048 // Spectrum and waveform values per frame
+#define ANALYSIS_SHM_ROWS 8    // Analysis rows per frame, `rows` of them are in use
+#define ANALYSIS_SHM_FENCE() __sync_synchronize()
+
+typedef struct analysis_shm_frame_s
+{
+  volatile uint64_t seq;    // Odd while the writer is in this slot
+  uint64_t index;           // Frames published before this one
+  uint64_t sample_position; // Stream sample the analysis window ends at (the audible one)
+  double monotonic;         // CLOCK_MONOTONIC seconds when it was published, comparable between processes
+  double song_time;         // Position in the track in seconds
+  float sample_rate;        // Of sample_position
+  float level;              // RMS of the waveform, 0..1
+  float bass;               // Energy of the lowest filterbank bands, 0..1
+  float beat;               // 1 on a bass onset, fades out
+  float pitch[2];           // Fundamental in Hz (0 if there is none) and confidence 0..1
+  int32_t spectrum_valid;   // 0 with the GPU analysis, the spectrum only exists on the GPU then
+  float spectrum_db[ANALYSIS_SHM_BINS]; // Smoothed magnitude in dB, bin i is i * analysis_rate / nfft Hz
+  float waveform[ANALYSIS_SHM_BINS];    // -1..1, triggered like the uBuffer waveform
+  float rows[ANALYSIS_SHM_ROWS][ANALYSIS_SHM_BINS]; // The uAnalysis rows, 0..1 (see the README for their layout)
+} AnalysisShmFrame;
+
+typedef struct analysis_shm_header_s
+{
+  volatile uint32_t magic; // Written last, a reader that sees it sees the rest of the header
+  uint32_t version;
+  uint32_t slots;
+  uint32_t bins;
+  uint32_t rows;
+  uint32_t nfft;
+  float analysis_rate;         // Of the spectrum
+  volatile uint64_t published; // Frames published so far, the newest is in slot (published - 1) % slots
+  AnalysisShmFrame frames[ANALYSIS_SHM_SLOTS];
+} AnalysisShmHeader;
+
+typedef struct analysis_shm_s
+{
+  AnalysisShmHeader *header;
+  char name[64];
+  int writer;
+} AnalysisShm;
+
+static double analysis_shm_now()
+{
+#ifndef _WIN32
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#else
+  return 0.0;
+#endif
+}
+
+// Maps the segment `name`, the writer creates it. Returns 0 on failure.
+static int analysis_shm_map(AnalysisShm *shm, const char *name, int writer)
+{
+  memset(shm, 0, sizeof(*shm));
+#ifndef _WIN32
+  int fd = shm_open(name, writer ? O_CREAT | O_RDWR : O_RDONLY, 0644);
+  if (fd < 0)
+  {
+    fprintf(stderr, "Couldn't open the shared memory [%s]!\n", name);
+    return 0;
+  }
+  if (writer && ftruncate(fd, sizeof(AnalysisShmHeader)) != 0)
+  {
+    fprintf(stderr, "Couldn't size the shared memory [%s]!\n", name);
+    close(fd);
+    return 0;
+  }
+  void *data = mmap(NULL, sizeof(AnalysisShmHeader), writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // The mapping keeps it open
+  if (data == MAP_FAILED)
+  {
+    fprintf(stderr, "Couldn't map the shared memory [%s]!\n", name);
+    return 0;
+  }
+  shm->header = (AnalysisShmHeader *)data;
+  snprintf(shm->name, sizeof(shm->name), "%s", name);
+  shm->writer = writer;
+  return 1;
+#else
+  (void)writer;
+  fprintf(stderr, "Shared memory [%s] isn't supported on Windows!\n", name);
+  return 0;
+#endif
+}
+
+// Unmaps the segment, the writer also removes the name (mapped readers keep their view of it)
+void analysis_shm_close(AnalysisShm *shm)
+{
+#ifndef _WIN32
+  if (shm->header != NULL)
+  {
+    if (shm->writer)
+    {
+      shm->header->magic = 0; // Readers that open it later see a dead segment
+      shm_unlink(shm->name);
+    }
+    munmap(shm->header, sizeof(AnalysisShmHeader));
+  }
+#endif
+  memset(shm, 0, sizeof(*shm));
+}
+
+// Writer side, returns 0 on failure
+int analysis_shm_create(AnalysisShm *shm, const char *name, uint32_t rows, uint32_t nfft, float analysis_rate)
+{
+  if (!analysis_shm_map(shm, name, 1))
+    return 0;
+  AnalysisShmHeader *h = shm->header;
+  h->magic = 0;
+  ANALYSIS_SHM_FENCE();
+  memset((char *)h + sizeof(h->magic), 0, sizeof(*h) - sizeof(h->magic));
+  h->version = ANALYSIS_SHM_VERSION;
+  h->slots = ANALYSIS_SHM_SLOTS;
+  h->bins = ANALYSIS_SHM_BINS;
+  h->rows = rows < ANALYSIS_SHM_ROWS ? rows : ANALYSIS_SHM_ROWS;
+  h->nfft = nfft;
+  h->analysis_rate = analysis_rate;
+  ANALYSIS_SHM_FENCE();
+  h->magic = ANALYSIS_SHM_MAGIC;
+  return 1;
+}
+
+// Writer side: the slot the next frame goes into, already marked as being written. Fill it and call
+// analysis_shm_publish(), nothing else may happen in between.
+AnalysisShmFrame *analysis_shm_begin(AnalysisShm *shm)
+{
+  AnalysisShmHeader *h = shm->header;
+  AnalysisShmFrame *frame = &h->frames[h->published % ANALYSIS_SHM_SLOTS];
+  frame->seq++; // Odd, readers in this slot will retry
+  ANALYSIS_SHM_FENCE();
+  frame->index = h->published;
+  frame->monotonic = analysis_shm_now();
+  return frame;
+}
+
+void analysis_shm_publish(AnalysisShm *shm, AnalysisShmFrame *frame)
+{
+  ANALYSIS_SHM_FENCE();
+  frame->seq++; // Even again, the frame is complete
+  ANALYSIS_SHM_FENCE();
+  shm->header->published++;
+}
+
+// Reader side, returns 0 if there is no segment or it isn't one of ours (yet)
+int analysis_shm_open(AnalysisShm *shm, const char *name)
+{
+  if (!analysis_shm_map(shm, name, 0))
+    return 0;
+  if (shm->header->magic != ANALYSIS_SHM_MAGIC || shm->header->version != ANALYSIS_SHM_VERSION)
+  {
+    fprintf(stderr, "[%s] isn't a CShaderSound analysis segment (or a different version)!\n", name);
+    analysis_shm_close(shm);
+    return 0;
+  }
+  ANALYSIS_SHM_FENCE();
+  return 1;
+}
+
+// Reader side: the newest complete frame, used in place. `seq` receives the counter analysis_shm_valid()
+// needs afterwards. NULL if nothing was published yet or the writer is gone.
+const AnalysisShmFrame *analysis_shm_latest(const AnalysisShm *shm, uint64_t *seq)
+{
+  const AnalysisShmHeader *h = shm->header;
+  if (h->magic != ANALYSIS_SHM_MAGIC)
+    return NULL;
+  uint64_t published = h->published;
+  for (uint64_t back = 1; back <= ANALYSIS_SHM_SLOTS && back <= published; back++) // The newest may be in progress
+  {
+    const AnalysisShmFrame *frame = &h->frames[(published - back) % ANALYSIS_SHM_SLOTS];
+    *seq = frame->seq;
+    ANALYSIS_SHM_FENCE();
+    if ((*seq & 1) == 0 && frame->index == published - back)
+      return frame;
+  }
+  return NULL;
+}
+
+// Reader side: whether everything read from `frame` since analysis_shm_latest() is consistent
+int analysis_shm_valid(const AnalysisShmFrame *frame, uint64_t seq)
+{
+  ANALYSIS_SHM_FENCE();
+  return frame->seq == seq;
+}
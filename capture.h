@@ -0,0 +1,162 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "raylib.h"
+
+// Live input source: a capture device (microphone/line in), a loopback device (what the system is playing,
+// only WASAPI supports it) or a WAV file that is played through miniaudio's null backend in real time,
+// so the whole live path can be tested without any audio hardware.
+// We use the miniaudio that is compiled into raylib, so the defines have to be the same as in raudio.c,
+// otherwise the struct layouts wouldn't match.
+#define MA_NO_JACK
+#define MA_NO_WAV
+#define MA_NO_FLAC
+#define MA_NO_MP3
+#define MA_NO_RESOURCE_MANAGER
+#define MA_NO_NODE_GRAPH
+#define MA_NO_ENGINE
+#define MA_NO_GENERATION
+#include "external/miniaudio.h"
+
+#define CAPTURE_DEFAULT_PERIOD 128 // Frames, ~3 ms at 48 kHz
+
+typedef enum capture_kind_enum
+{
+  CAPTURE_DEVICE = 0,
+  CAPTURE_LOOPBACK,
+  CAPTURE_WAV,
+} CaptureKind;
+
+// Gets every captured period as interleaved float frames, runs on miniaudio's thread
+typedef void (*CaptureSink)(const float *frames, unsigned int frame_count, unsigned int channels);
+
+typedef struct capture_s
+{
+  CaptureKind kind;
+  bool active;
+  volatile bool sinking; // The sink may be called, set before the device starts (its callback can run before
+                         // ma_device_start() returns) and cleared after it stopped, unlike `active`
+  unsigned int period_frames; // Requested period size, smaller periods mean less latency but more wakeups
+  unsigned int sample_rate;   // What the device actually runs at
+  unsigned int channels;
+  char name[256];
+  CaptureSink sink;
+  ma_context context;
+  ma_device device;
+  Wave wav; // Simulated source, float frames
+  unsigned long long wav_cursor;
+} Capture;
+
+static void capture_data_callback(ma_device *device, void *output, const void *input, ma_uint32 frame_count)
+{
+  Capture *cap = (Capture *)device->pUserData;
+  (void)output;
+  if (cap->kind != CAPTURE_WAV)
+  {
+    cap->sink((const float *)input, frame_count, cap->channels);
+    return;
+  }
+  // The null backend only delivers silence, but at the right pace, so we swap in the file (looping)
+  static float frames[4096 * 2];
+  const float *wav = (const float *)cap->wav.data;
+  while (frame_count > 0)
+  {
+    ma_uint32 n = frame_count < 4096 ? frame_count : 4096;
+    for (ma_uint32 i = 0; i < n; i++)
+    {
+      memcpy(frames + i * cap->channels, wav + cap->wav_cursor * cap->channels, cap->channels * sizeof(float));
+      if (++cap->wav_cursor >= cap->wav.frameCount)
+        cap->wav_cursor = 0;
+    }
+    cap->sink(frames, n, cap->channels);
+    frame_count -= n;
+  }
+}
+
+void capture_stop(Capture *cap)
+{
+  if (!cap->active)
+    return;
+  ma_device_uninit(&cap->device); // Waits for the callback to return
+  cap->sinking = false;
+  ma_context_uninit(&cap->context);
+  if (cap->kind == CAPTURE_WAV)
+    UnloadWave(cap->wav);
+  cap->active = false;
+}
+
+// Returns false if the device couldn't be opened, `wav_path` is only used for CAPTURE_WAV
+bool capture_start(Capture *cap, CaptureKind kind, unsigned int period_frames, const char *wav_path, CaptureSink sink)
+{
+  capture_stop(cap);
+  memset(cap, 0, sizeof(*cap));
+  cap->kind = kind;
+  cap->sink = sink;
+  cap->period_frames = period_frames > 0 ? period_frames : CAPTURE_DEFAULT_PERIOD;
+  cap->channels = 2; // miniaudio converts to what we ask for, the callback can run before ma_device_start() returns
+
+  ma_device_config config = ma_device_config_init(kind == CAPTURE_LOOPBACK ? ma_device_type_loopback : ma_device_type_capture);
+  config.capture.format = ma_format_f32;
+  config.capture.channels = 2;
+  config.sampleRate = 0; // Native rate, no resampling in front of the analysis
+  config.periodSizeInFrames = cap->period_frames;
+  config.periods = 2;
+  config.performanceProfile = ma_performance_profile_low_latency;
+  config.dataCallback = capture_data_callback;
+  config.pUserData = cap;
+
+  ma_result result;
+  if (kind == CAPTURE_WAV)
+  {
+    cap->wav = LoadWave(wav_path);
+    if (!IsWaveReady(cap->wav))
+    {
+      fprintf(stderr, "ERROR: Couldn't load [%s] for the simulated capture device\n", wav_path);
+      return false;
+    }
+    WaveFormat(&cap->wav, cap->wav.sampleRate, 32, 2);
+    config.sampleRate = cap->wav.sampleRate;
+    ma_backend backends[] = {ma_backend_null};
+    result = ma_context_init(backends, 1, NULL, &cap->context);
+  }
+  else
+  {
+    result = ma_context_init(NULL, 0, NULL, &cap->context);
+  }
+  if (result != MA_SUCCESS)
+  {
+    fprintf(stderr, "ERROR: Couldn't initialize the audio context for capturing (%s)\n", ma_result_description(result));
+    if (kind == CAPTURE_WAV)
+      UnloadWave(cap->wav);
+    return false;
+  }
+  result = ma_device_init(&cap->context, &config, &cap->device);
+  if (result == MA_SUCCESS)
+  {
+    cap->sinking = true;
+    __sync_synchronize(); // Seen by other threads before the first callback
+    result = ma_device_start(&cap->device);
+    if (result != MA_SUCCESS)
+    {
+      ma_device_uninit(&cap->device);
+      cap->sinking = false;
+    }
+  }
+  if (result != MA_SUCCESS)
+  {
+    fprintf(stderr, "ERROR: Couldn't open the capture device (%s)\n", ma_result_description(result));
+    ma_context_uninit(&cap->context);
+    if (kind == CAPTURE_WAV)
+      UnloadWave(cap->wav);
+    return false;
+  }
+  cap->sample_rate = cap->device.sampleRate;
+  cap->period_frames = cap->device.capture.internalPeriodSizeInFrames;
+  if (kind == CAPTURE_WAV)
+    snprintf(cap->name, sizeof(cap->name), "Simulated: %s", GetFileName(wav_path));
+  else
+    snprintf(cap->name, sizeof(cap->name), "%s", cap->device.capture.name);
+  cap->active = true;
+  return true;
+}
@@ -0,0 +1,253 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+
+// Musically spaced spectra without a huge FFT.
+// Constant-Q (Brown & Puckette): every bin is the inner product of the frame with a windowed complex
+// exponential that is Q periods long, so the treble bins only look at the newest few milliseconds and the
+// bass bins at the whole frame. The kernels are transformed once and only their few significant spectral
+// values are kept, so a frame costs one FFT plus a short sparse product per bin.
+// Chirp-Z zoom (Bluestein): evaluates the spectrum at M points spread over an arbitrary band, e.g.
+// 20-500 Hz at a fraction of a Hz spacing, as a convolution done with three FFTs of about N + M points.
+
+#define CQT_BINS_PER_OCTAVE 12
+#define CQT_THRESHOLD 0.0054f // Spectral kernel values below this are dropped (the value from the paper)
+
+#ifndef CQT_PI
+#define CQT_PI 3.14159265358979323846
+#endif
+
+// In place iterative radix-2 FFT, `n` has to be a power of two, the inverse is not scaled
+void cplx_fft(float complex *x, unsigned int n, int inverse)
+{
+  for (unsigned int i = 1, j = 0; i < n; i++) // Bit reversal permutation
+  {
+    unsigned int bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j)
+    {
+      float complex tmp = x[i];
+      x[i] = x[j];
+      x[j] = tmp;
+    }
+  }
+  for (unsigned int len = 2; len <= n; len <<= 1)
+  {
+    double angle = (inverse ? 2.0 : -2.0) * CQT_PI / len;
+    float complex step = (float)cos(angle) + (float)sin(angle) * I;
+    for (unsigned int i = 0; i < n; i += len)
+    {
+      float complex w = 1.0f;
+      for (unsigned int k = 0; k < len / 2; k++)
+      {
+        float complex e = x[i + k];
+        float complex o = x[i + k + len / 2] * w;
+        x[i + k] = e + o;
+        x[i + k + len / 2] = e - o;
+        w *= step;
+      }
+    }
+  }
+}
+
+typedef struct cqt_s
+{
+  unsigned int n;    // Frame length, the longest kernel
+  unsigned int bins; // Semitones from min_freq up
+  float min_freq;
+  float sample_rate;
+  unsigned int *kernel_start;  // bins + 1 offsets into kernel_index/kernel_value
+  unsigned int *kernel_index;  // FFT bin of every kept kernel value
+  float complex *kernel_value; // conj(K[index]) / n
+  float complex *spectrum;     // Scratch, n
+} Cqt;
+
+void cqt_free(Cqt *c)
+{
+  free(c->kernel_start);
+  free(c->kernel_index);
+  free(c->kernel_value);
+  free(c->spectrum);
+  memset(c, 0, sizeof(*c));
+}
+
+// Center frequency of bin k
+float cqt_bin_freq(const Cqt *c, unsigned int k)
+{
+  return c->min_freq * powf(2.0f, (float)k / CQT_BINS_PER_OCTAVE);
+}
+
+// Builds the sparse spectral kernels, takes a while (an FFT per bin) so only do it when the rate changes.
+// The kernels end at the newest sample of the frame. Bins whose Q periods don't fit into n samples are
+// clamped to the whole frame, so they get wider than a semitone. Bins above Nyquist are dropped.
+// Returns 0 on failure
+int cqt_init(Cqt *c, unsigned int n, unsigned int bins, float min_freq, float sample_rate)
+{
+  memset(c, 0, sizeof(*c));
+  c->n = n;
+  c->min_freq = min_freq;
+  c->sample_rate = sample_rate;
+  while (bins > 0 && min_freq * powf(2.0f, (float)(bins - 1) / CQT_BINS_PER_OCTAVE) >= 0.5f * sample_rate)
+    bins--;
+  c->bins = bins;
+  const double q = 1.0 / (pow(2.0, 1.0 / CQT_BINS_PER_OCTAVE) - 1.0);
+
+  unsigned int cap = 16 * n;
+  c->kernel_start = (unsigned int *)malloc((bins + 1) * sizeof(unsigned int));
+  c->kernel_index = (unsigned int *)malloc(cap * sizeof(unsigned int));
+  c->kernel_value = (float complex *)malloc(cap * sizeof(float complex));
+  c->spectrum = (float complex *)malloc(n * sizeof(float complex));
+  if (!c->kernel_start || !c->kernel_index || !c->kernel_value || !c->spectrum)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    cqt_free(c);
+    return 0;
+  }
+
+  unsigned int count = 0;
+  for (unsigned int k = 0; k < bins; k++)
+  {
+    double freq = min_freq * pow(2.0, (double)k / CQT_BINS_PER_OCTAVE);
+    unsigned int len = (unsigned int)ceil(q * sample_rate / freq);
+    if (len > n)
+      len = n;
+    memset(c->spectrum, 0, n * sizeof(float complex));
+    for (unsigned int i = 0; i < len; i++) // Hann windowed, normalized so a full scale sine gives 0.25
+    {
+      double window = 0.5 * (1.0 - cos(2.0 * CQT_PI * (i + 0.5) / len)) / len;
+      double phase = 2.0 * CQT_PI * freq * i / sample_rate;
+      c->spectrum[n - len + i] = (float)(window * cos(phase)) + (float)(window * sin(phase)) * I;
+    }
+    cplx_fft(c->spectrum, n, 0);
+    c->kernel_start[k] = count;
+    for (unsigned int j = 0; j < n; j++)
+    {
+      if (cabsf(c->spectrum[j]) < CQT_THRESHOLD)
+        continue;
+      if (count == cap)
+      {
+        cap *= 2;
+        unsigned int *index = (unsigned int *)realloc(c->kernel_index, cap * sizeof(unsigned int));
+        float complex *value = (float complex *)realloc(c->kernel_value, cap * sizeof(float complex));
+        if (index)
+          c->kernel_index = index;
+        if (value)
+          c->kernel_value = value;
+        if (!index || !value)
+        {
+          fprintf(stderr, "ERROR: Memory allocation failed\n");
+          cqt_free(c);
+          return 0;
+        }
+      }
+      c->kernel_index[count] = j;
+      c->kernel_value[count] = conjf(c->spectrum[j]) / (float)n;
+      count++;
+    }
+  }
+  c->kernel_start[bins] = count;
+  return 1;
+}
+
+// Magnitudes of every bin for the newest n samples in `frame` (not windowed, the kernels are)
+void cqt_run(Cqt *c, const float *frame, float *out)
+{
+  for (unsigned int i = 0; i < c->n; i++)
+    c->spectrum[i] = frame[i];
+  cplx_fft(c->spectrum, c->n, 0);
+  for (unsigned int k = 0; k < c->bins; k++)
+  {
+    float complex sum = 0.0f;
+    for (unsigned int i = c->kernel_start[k]; i < c->kernel_start[k + 1]; i++)
+      sum += c->spectrum[c->kernel_index[i]] * c->kernel_value[i];
+    out[k] = cabsf(sum);
+  }
+}
+
+typedef struct czt_s
+{
+  unsigned int n; // Input length
+  unsigned int m; // Output points
+  unsigned int l; // Convolution length, power of two >= n + m - 1
+  float low, high, sample_rate;
+  float complex *chirp;  // A^-i * W^(i^2/2), n
+  float complex *post;   // W^(k^2/2), m
+  float complex *filter; // FFT of W^(-k^2/2) wrapped around, l
+  float complex *work;   // Scratch, l
+} Czt;
+
+void czt_free(Czt *z)
+{
+  free(z->chirp);
+  free(z->post);
+  free(z->filter);
+  free(z->work);
+  memset(z, 0, sizeof(*z));
+}
+
+// exp(-i pi * step * k^2) with the phase reduced in double first, k^2 gets large
+static float complex czt_chirp(double step, unsigned int k)
+{
+  double phase = fmod(step * (double)k * (double)k, 2.0);
+  return (float)cos(CQT_PI * phase) - (float)sin(CQT_PI * phase) * I;
+}
+
+// Returns 0 on failure
+int czt_init(Czt *z, unsigned int n, unsigned int m, float low, float high, float sample_rate)
+{
+  memset(z, 0, sizeof(*z));
+  z->n = n;
+  z->m = m;
+  z->low = low;
+  z->high = high;
+  z->sample_rate = sample_rate;
+  for (z->l = 1; z->l < n + m - 1; z->l <<= 1)
+    ;
+  z->chirp = (float complex *)malloc(n * sizeof(float complex));
+  z->post = (float complex *)malloc(m * sizeof(float complex));
+  z->filter = (float complex *)calloc(z->l, sizeof(float complex));
+  z->work = (float complex *)malloc(z->l * sizeof(float complex));
+  if (!z->chirp || !z->post || !z->filter || !z->work)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    czt_free(z);
+    return 0;
+  }
+  const double step = (double)(high - low) / ((m > 1 ? m - 1 : 1) * (double)sample_rate); // Cycles per sample between points
+  const double start = (double)low / sample_rate;
+  for (unsigned int i = 0; i < n; i++)
+  {
+    double phase = fmod(start * i, 1.0);
+    float complex a = (float)cos(2.0 * CQT_PI * phase) - (float)sin(2.0 * CQT_PI * phase) * I; // A^-i
+    z->chirp[i] = a * czt_chirp(step, i);
+  }
+  for (unsigned int k = 0; k < m; k++)
+    z->post[k] = czt_chirp(step, k);
+  for (unsigned int k = 0; k < m; k++)
+    z->filter[k] = conjf(czt_chirp(step, k));
+  for (unsigned int k = 1; k < n; k++)
+    z->filter[z->l - k] = conjf(czt_chirp(step, k));
+  cplx_fft(z->filter, z->l, 0);
+  for (unsigned int i = 0; i < z->l; i++)
+    z->filter[i] /= (float)z->l; // The scaling of the inverse FFT
+  return 1;
+}
+
+// Magnitudes of the m points between low and high for the n samples in `frame` (window them first)
+void czt_run(Czt *z, const float *frame, float *out)
+{
+  for (unsigned int i = 0; i < z->n; i++)
+    z->work[i] = frame[i] * z->chirp[i];
+  memset(z->work + z->n, 0, (z->l - z->n) * sizeof(float complex));
+  cplx_fft(z->work, z->l, 0);
+  for (unsigned int i = 0; i < z->l; i++)
+    z->work[i] *= z->filter[i];
+  cplx_fft(z->work, z->l, 1);
+  for (unsigned int k = 0; k < z->m; k++)
+    out[k] = cabsf(z->work[k] * z->post[k]);
+}
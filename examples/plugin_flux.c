@@ -0,0 +1,80 @@
+// Example analysis plugin: spectral flux (how much the spectrum rose since the last hop) per bin in its row,
+// and in its uniform slots
+//   0: total flux, relative to the recent maximum (0..1), a good onset detector
+//   1: spectral centroid relative to the Nyquist frequency (0..1), how bright the sound is
+//   2: RMS of the newest 1024 samples
+// Build it with
+//   gcc -std=c99 -Wall -pedantic -O2 -shared -fPIC -I.. plugin_flux.c -o plugin_flux.so -lm
+// and run CShaderSound with --plugin examples/plugin_flux.so. Rebuilding it while the program runs reloads it.
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "plugin_abi.h"
+
+#define FLUX_BINS 2048
+
+typedef struct flux_s
+{
+  float previous[FLUX_BINS];
+  float peak; // Recent maximum of the total flux, decays
+  int primed;
+} Flux;
+
+static void *flux_create(void)
+{
+  return calloc(1, sizeof(Flux));
+}
+
+static void flux_destroy(void *state)
+{
+  free(state);
+}
+
+static void flux_process(void *state, const CssPluginInput *in, CssPluginOutput *out)
+{
+  Flux *flux = (Flux *)state;
+  if (flux == NULL)
+    return;
+  unsigned int count = in->sample_count < 1024 ? in->sample_count : 1024;
+  float sum = 0.0f;
+  for (unsigned int i = in->sample_count - count; i < in->sample_count; i++)
+    sum += in->samples[i] * in->samples[i];
+  out->values[2] = count > 0 ? sqrtf(sum / count) : 0.0f;
+  if (in->spectrum_db == NULL) // GPU analysis, no spectrum on the CPU
+  {
+    memset(out->row, 0, out->row_size * sizeof(float));
+    out->values[0] = out->values[1] = 0.0f;
+    return;
+  }
+  unsigned int bins = in->bins < FLUX_BINS ? in->bins : FLUX_BINS;
+  bins = bins < out->row_size ? bins : out->row_size;
+  float total = 0.0f, weighted = 0.0f, energy = 0.0f;
+  for (unsigned int i = 0; i < bins; i++)
+  {
+    float rise = flux->primed ? in->spectrum_db[i] - flux->previous[i] : 0.0f;
+    rise = rise > 0.0f ? rise : 0.0f;
+    out->row[i] = rise / 12.0f; // 12 dB rise is 1
+    total += rise;
+    float magnitude = powf(10.0f, in->spectrum_db[i] / 20.0f);
+    weighted += magnitude * (float)i;
+    energy += magnitude;
+    flux->previous[i] = in->spectrum_db[i];
+  }
+  flux->primed = 1;
+  flux->peak = fmaxf(total, flux->peak * expf(-in->delta_time / 2.0f)); // Forgets a loud part after a few seconds
+  out->values[0] = flux->peak > 0.0f ? total / flux->peak : 0.0f;
+  out->values[1] = energy > 0.0f ? weighted / energy / (float)(in->nfft / 2) : 0.0f;
+}
+
+static const CssPlugin flux_plugin = {
+    .abi_version = CSS_PLUGIN_ABI_VERSION,
+    .name = "spectral flux",
+    .create = flux_create,
+    .destroy = flux_destroy,
+    .process = flux_process,
+};
+
+CSS_PLUGIN_EXPORT const CssPlugin *css_plugin_entry(void)
+{
+  return &flux_plugin;
+}
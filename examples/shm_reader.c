@@ -0,0 +1,56 @@
+// Reads the analysis CShaderSound publishes with `--publish /cshadersound` and prints a bar spectrum with
+// the level, bass and beat a few times per second. Build it with
+//   gcc -std=c99 -Wall -pedantic -I.. shm_reader.c -o shm_reader (-lrt on older glibc)
+// The frames are used right in the shared memory, analysis_shm_valid() tells if the writer overwrote one
+// while it was being read.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "analysis_shm.h"
+
+#define BARS 32
+
+int main(int argc, char **argv)
+{
+  const char *name = argc > 1 ? argv[1] : ANALYSIS_SHM_NAME;
+  AnalysisShm shm;
+  if (!analysis_shm_open(&shm, name))
+    return 1;
+  printf("%s: %u bins, %u rows, spectrum at %.0f Hz\n", name, shm.header->bins, shm.header->rows, shm.header->analysis_rate);
+  const struct timespec period = {.tv_sec = 0, .tv_nsec = 100 * 1000 * 1000};
+  for (;;)
+  {
+    uint64_t seq;
+    const AnalysisShmFrame *frame = analysis_shm_latest(&shm, &seq);
+    if (frame == NULL)
+    {
+      if (shm.header->magic != ANALYSIS_SHM_MAGIC)
+        break; // The writer closed it
+      nanosleep(&period, NULL);
+      continue;
+    }
+    // Log spaced bars over the lowest 1024 bins (0 - 5.5 kHz), the loudest bin of each
+    char bars[BARS + 1];
+    for (int b = 0; b < BARS; b++)
+    {
+      int first = (int)powf(1024.0f, (float)b / BARS), last = (int)powf(1024.0f, (float)(b + 1) / BARS);
+      float peak = -120.0f;
+      for (int i = first; i <= last && i < (int)ANALYSIS_SHM_BINS; i++)
+        peak = fmaxf(peak, frame->spectrum_db[i]);
+      bars[b] = " .:-=+*#%@"[peak < -60.0f ? 0 : peak > 0.0f ? 9 : (int)((peak + 60.0f) / 60.0f * 9.0f)];
+    }
+    bars[BARS] = '\0';
+    double song_time = frame->song_time;
+    float level = frame->level, bass = frame->bass, beat = frame->beat;
+    int spectrum_valid = frame->spectrum_valid;
+    if (!analysis_shm_valid(frame, seq)) // Lapped while reading, the values may be torn
+      continue;
+    printf("%8.2f s [%s] level %.2f bass %.2f %s\n", song_time, spectrum_valid ? bars : "no spectrum (GPU analysis)",
+           level, bass, beat > 0.9f ? "BEAT" : "");
+    fflush(stdout);
+    nanosleep(&period, NULL);
+  }
+  analysis_shm_close(&shm);
+  return 0;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <string.h>
+#include <math.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FILTERBANK_SSE 1
+#endif
+
+// Time domain band energies with sub-period latency, for beat reactive shaders where an 8192 point FFT
+// lags too much. A bank of bandpass biquads (RBJ, 0 dB peak) with attack/release envelope followers on the
+// squared output. It runs on the audio thread over every period that goes into the ring. The state is
+// kept as structure of arrays so four bands are filtered at once with SSE. The loop runs over the bands
+// and then over the samples, so the state of a group stays in registers for the whole period.
+// The main thread only designs coefficients (they are swapped in by the audio thread at the start of the
+// next period) and reads the energies of the last finished period.
+
+#define FILTERBANK_MAX_BANDS 64 // Multiple of 4
+#define FILTERBANK_ATTACK 0.001f // Seconds
+#define FILTERBANK_RELEASE 0.060f
+
+typedef struct filterbank_coefs_s
+{
+  unsigned int bands;
+  float b0[FILTERBANK_MAX_BANDS]; // b1 is 0 and b2 is -b0 for a bandpass
+  float a1[FILTERBANK_MAX_BANDS];
+  float a2[FILTERBANK_MAX_BANDS];
+  float attack[FILTERBANK_MAX_BANDS]; // One pole coefficients of the envelope
+  float release[FILTERBANK_MAX_BANDS];
+} FilterbankCoefs;
+
+typedef struct filterbank_s
+{
+  unsigned int bands; // Of the last design (the audio thread uses coefs.bands), rounded up to a multiple of 4
+  float sample_rate;  // What the last design is for
+  float freq[FILTERBANK_MAX_BANDS]; // Center frequencies
+  FilterbankCoefs coefs;            // Only touched by the audio thread
+  FilterbankCoefs pending;
+  volatile int has_pending;
+  float z1[FILTERBANK_MAX_BANDS]; // Transposed direct form II state
+  float z2[FILTERBANK_MAX_BANDS];
+  float env[FILTERBANK_MAX_BANDS]; // Mean square
+  float out[2][FILTERBANK_MAX_BANDS]; // RMS, the audio thread writes one while the other one is published
+  volatile int out_index;
+  volatile unsigned long long periods; // Published periods, so the reader can tell if anything new came in
+} Filterbank;
+
+// Log spaced bands from `low` to `high` Hz, each about as wide as the spacing. Called from the main thread.
+// Returns 0 if the previous design wasn't picked up by the audio thread yet, try again next frame.
+int filterbank_design(Filterbank *fb, unsigned int bands, float low, float high, float sample_rate)
+{
+  if (fb->has_pending)
+    return 0;
+  if (bands > FILTERBANK_MAX_BANDS)
+    bands = FILTERBANK_MAX_BANDS;
+  if (high > 0.45f * sample_rate)
+    high = 0.45f * sample_rate;
+  memset(&fb->pending, 0, sizeof(fb->pending));
+  const double ratio = pow(high / low, 1.0 / (bands > 1 ? bands - 1 : 1));
+  const double octaves = log2(ratio);
+  const double q = sqrt(pow(2.0, octaves)) / (pow(2.0, octaves) - 1.0);
+  for (unsigned int b = 0; b < bands; b++)
+  {
+    double freq = low * pow(ratio, b);
+    double w0 = 2.0 * 3.14159265358979323846 * freq / sample_rate;
+    double alpha = sin(w0) / (2.0 * q);
+    double a0 = 1.0 + alpha;
+    fb->freq[b] = (float)freq;
+    fb->pending.b0[b] = (float)(alpha / a0);
+    fb->pending.a1[b] = (float)(-2.0 * cos(w0) / a0);
+    fb->pending.a2[b] = (float)((1.0 - alpha) / a0);
+    fb->pending.attack[b] = 1.0f - expf(-1.0f / (FILTERBANK_ATTACK * sample_rate));
+    fb->pending.release[b] = 1.0f - expf(-1.0f / (FILTERBANK_RELEASE * sample_rate));
+  }
+  fb->bands = (bands + 3) & ~3u; // The padding bands have zero coefficients
+  fb->pending.bands = fb->bands;
+  fb->sample_rate = sample_rate;
+  fb->has_pending = 1;
+  return 1;
+}
+
+// Filters `count` mono samples, called from the audio thread, publishes the energies at the end
+void filterbank_process(Filterbank *fb, const float *samples, unsigned int count)
+{
+  if (fb->has_pending) // New coefficients, the old state would ring at the wrong frequencies
+  {
+    fb->coefs = fb->pending;
+    memset(fb->z1, 0, sizeof(fb->z1));
+    memset(fb->z2, 0, sizeof(fb->z2));
+    memset(fb->env, 0, sizeof(fb->env));
+    fb->has_pending = 0;
+  }
+  const FilterbankCoefs *c = &fb->coefs;
+#ifdef FILTERBANK_SSE
+  unsigned int csr = _mm_getcsr();
+  _mm_setcsr(csr | 0x8040); // Flush denormals to zero, the decaying state would crawl through them in silence
+  for (unsigned int b = 0; b < c->bands; b += 4)
+  {
+    __m128 b0 = _mm_loadu_ps(c->b0 + b);
+    __m128 a1 = _mm_loadu_ps(c->a1 + b);
+    __m128 a2 = _mm_loadu_ps(c->a2 + b);
+    __m128 attack = _mm_loadu_ps(c->attack + b);
+    __m128 release = _mm_loadu_ps(c->release + b);
+    __m128 z1 = _mm_loadu_ps(fb->z1 + b);
+    __m128 z2 = _mm_loadu_ps(fb->z2 + b);
+    __m128 env = _mm_loadu_ps(fb->env + b);
+    for (unsigned int i = 0; i < count; i++)
+    {
+      __m128 x = _mm_mul_ps(b0, _mm_set1_ps(samples[i]));
+      __m128 y = _mm_add_ps(x, z1);
+      z1 = _mm_sub_ps(z2, _mm_mul_ps(a1, y));
+      z2 = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(x, _mm_mul_ps(a2, y)));
+      __m128 power = _mm_mul_ps(y, y);
+      __m128 rising = _mm_cmpgt_ps(power, env);
+      __m128 k = _mm_or_ps(_mm_and_ps(rising, attack), _mm_andnot_ps(rising, release));
+      env = _mm_add_ps(env, _mm_mul_ps(k, _mm_sub_ps(power, env)));
+    }
+    _mm_storeu_ps(fb->z1 + b, z1);
+    _mm_storeu_ps(fb->z2 + b, z2);
+    _mm_storeu_ps(fb->env + b, env);
+  }
+  _mm_setcsr(csr);
+#else
+  for (unsigned int b = 0; b < c->bands; b++) // Same structure, simple enough for the compiler to vectorize
+  {
+    float z1 = fb->z1[b], z2 = fb->z2[b], env = fb->env[b];
+    for (unsigned int i = 0; i < count; i++)
+    {
+      float x = c->b0[b] * (samples[i] + 1e-18f); // The offset keeps the state out of the denormals
+      float y = x + z1;
+      z1 = z2 - c->a1[b] * y;
+      z2 = -x - c->a2[b] * y;
+      float power = y * y;
+      env += (power > env ? c->attack[b] : c->release[b]) * (power - env);
+    }
+    fb->z1[b] = z1;
+    fb->z2[b] = z2;
+    fb->env[b] = env;
+  }
+#endif
+  int next = 1 - fb->out_index;
+  for (unsigned int b = 0; b < c->bands; b++)
+    fb->out[next][b] = sqrtf(fb->env[b]);
+  fb->out_index = next;
+  fb->periods++;
+}
+
+// RMS of every band after the last published period, a full scale sine gives a bit less than 1 in its band
+const float *filterbank_energies(const Filterbank *fb)
+{
+  return fb->out[fb->out_index];
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include "raylib.h"
+#include "external/glad.h" // Only the declarations, raylib loads the GL functions; rlgl has no uniform buffers
+
+// All per frame host data in one std140 uniform block. It is uploaded with a single glBufferSubData() and
+// sits on a fixed binding point, so a new value is one more struct member instead of another location to
+// look up and another SetShaderValue() every frame. frame_block_glsl is part of the prelude shader_source_assemble()
+// puts after the #version line, shaders read `uFrame.time`, `uFrame.resolution`, ... The instance name keeps
+// the members from clashing with the loose uniforms (uTime, uResolution, ...), so old shaders compile unchanged.
+
+#define FRAME_BLOCK_BINDING 0
+
+// std140 layout: the scalars on 4 bytes, vec2 on 8, no vec3 or arrays, padded to 16 bytes.
+// Has to match frame_block_glsl member by member.
+typedef struct frame_data_s
+{
+  float time;          // Seconds since the program started
+  float song_time;     // Audible position in the track
+  float delta_time;    // Of the last frame
+  float latency;       // Output latency the visuals are delayed by
+  float resolution[2]; // Canvas size in pixels
+  float pitch[2];      // Fundamental in Hz and confidence
+  float scope_offset;  // Sub-sample position of the waveform trigger
+  float sample_rate;   // Of the device
+  float level;         // RMS of the waveform row, 0..1
+  float bass;          // Filterbank energy of the lowest bands, 0..1
+  float beat;          // 1 on a bass onset, fades out
+  int frame;           // Frames drawn so far
+  float padding[2];
+} FrameData;
+
+// Only declared for GLSL 1.40 and newer, older versions have no uniform blocks
+static const char *frame_block_glsl =
+    "#if __VERSION__ >= 140\n"
+    "layout(std140) uniform FrameData\n"
+    "{\n"
+    "  float time;\n"
+    "  float songTime;\n"
+    "  float deltaTime;\n"
+    "  float latency;\n"
+    "  vec2 resolution;\n"
+    "  vec2 pitch;\n"
+    "  float scopeOffset;\n"
+    "  float sampleRate;\n"
+    "  float level;\n"
+    "  float bass;\n"
+    "  float beat;\n"
+    "  int frame;\n"
+    "} uFrame;\n"
+    "#endif\n";
+
+typedef struct frame_block_s
+{
+  unsigned int ubo;
+  FrameData data;
+} FrameBlock;
+
+// Needs a GL context
+void frame_block_init(FrameBlock *b)
+{
+  memset(b, 0, sizeof(*b));
+  glGenBuffers(1, &b->ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, b->ubo);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, b->ubo); // raylib doesn't use uniform buffers, it stays bound
+}
+
+void frame_block_unload(FrameBlock *b)
+{
+  if (b->ubo != 0)
+    glDeleteBuffers(1, &b->ubo);
+  b->ubo = 0;
+}
+
+// Once per frame, after filling b->data
+void frame_block_upload(const FrameBlock *b)
+{
+  glBindBuffer(GL_UNIFORM_BUFFER, b->ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &b->data);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Points the shader's FrameData block (if it uses it) at the buffer
+void frame_block_bind_shader(Shader shader)
+{
+  unsigned int index = glGetUniformBlockIndex(shader.id, "FrameData");
+  if (index != GL_INVALID_INDEX)
+    glUniformBlockBinding(shader.id, index, FRAME_BLOCK_BINDING);
+}
@@ -0,0 +1,333 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "raylib.h"
+#include "rlgl.h"
+
+// Spectrum analysis on the GPU, an alternative to fft() + fft_postprocess() for when the CPU is the bottleneck.
+// The windowed samples are uploaded as a float texture and transformed with a Stockham FFT (radix-4 passes
+// and one radix-2 pass if log2(n) is odd) that ping-pongs between two float render targets. Stockham sorts
+// itself, so there is no bit reversal pass. Magnitude, dB, smoothing and the min/max normalization are
+// further passes, the result is a BUFFER_SIZE x 1 float texture with the same layout as uBuffer
+// (.r is the normalized spectrum, .g the amplitude) that is bound directly, nothing is read back.
+// NOTE: Needs float render targets (GL 3.3 / GLES 3.2), gpu_fft_init() fails without them.
+
+#define GPU_FFT_ROW 1024   // Texels per row of the n-point textures, the minimum GL 3.3 texture size
+#define GPU_FFT_REDUCE 16  // Texels folded per min/max reduction pass (also hardcoded in gpu_fft_reduce_fs)
+#define GPU_FFT_MAX_REDUCE 8
+
+typedef struct gpu_fft_s
+{
+  bool ready;
+  int n;     // FFT size, power of two
+  int bins;  // Width of the output (the lower bins of the spectrum)
+  int width; // Layout of the n-point textures, index = y * width + x
+  int height;
+  Texture2D input;            // R32F windowed samples
+  Texture2D amp;              // R32F amplitude, bins x 1
+  RenderTexture2D work[2];    // Complex spectrum in .rg, ping-pong between the passes
+  int work_cur;               // The one holding the finished spectrum
+  RenderTexture2D smooth[2];  // Smoothed dB in .r and .g (so it can be reduced like a min/max pair)
+  int smooth_cur;
+  RenderTexture2D reduce[GPU_FFT_MAX_REDUCE]; // min/max in .rg, the last one is 1 x 1
+  int reduce_count;
+  RenderTexture2D output; // What gets bound as uBuffer
+  Shader pass_shader;
+  Shader mag_shader;
+  Shader reduce_shader;
+  Shader out_shader;
+  int pass_src_loc, pass_n_loc, pass_width_loc, pass_p_loc, pass_radix_loc;
+  int mag_spectrum_loc, mag_prev_loc, mag_width_loc, mag_smoothing_loc;
+  int reduce_src_loc, reduce_count_loc;
+  int out_smooth_loc, out_range_loc, out_amp_loc;
+} GpuFft;
+
+// One Stockham pass: every output texel j gathers its `uRadix` inputs and does its row of the radix-point DFT,
+// with the twiddle folded in: y[j] = sum_r x[i + r * n / R] * exp(-2 pi i * r * (j mod pR) / pR)
+static const char *gpu_fft_pass_fs =
+    "#version 330\n"
+    "out vec4 finalColor;\n"
+    "uniform sampler2D uSrc;\n"
+    "uniform int uN;\n"
+    "uniform int uWidth;\n"
+    "uniform int uP;\n"
+    "uniform int uRadix;\n"
+    "vec2 fetch(int i) { return texelFetch(uSrc, ivec2(i % uWidth, i / uWidth), 0).rg; }\n"
+    "void main()\n"
+    "{\n"
+    "  int j = int(gl_FragCoord.y) * uWidth + int(gl_FragCoord.x);\n"
+    "  int span = uP * uRadix;\n"
+    "  int k = j % uP;\n"
+    "  int i = (j - k - ((j / uP) % uRadix) * uP) / uRadix + k;\n"
+    "  int m = j % span;\n"
+    "  vec2 acc = vec2(0.0);\n"
+    "  for (int r = 0; r < uRadix; r++)\n"
+    "  {\n"
+    "    float a = -6.283185307179586 * float((r * m) % span) / float(span);\n"
+    "    vec2 v = fetch(i + r * (uN / uRadix));\n"
+    "    vec2 w = vec2(cos(a), sin(a));\n"
+    "    acc += vec2(v.x * w.x - v.y * w.y, v.x * w.y + v.y * w.x);\n"
+    "  }\n"
+    "  finalColor = vec4(acc, 0.0, 1.0);\n"
+    "}\n";
+
+// Same as fft_postprocess(): dB (0 instead of -inf) and exponential smoothing
+static const char *gpu_fft_mag_fs =
+    "#version 330\n"
+    "out vec4 finalColor;\n"
+    "uniform sampler2D uSpectrum;\n"
+    "uniform sampler2D uPrev;\n"
+    "uniform int uWidth;\n"
+    "uniform float uSmoothing;\n"
+    "void main()\n"
+    "{\n"
+    "  int i = int(gl_FragCoord.x);\n"
+    "  float mag = length(texelFetch(uSpectrum, ivec2(i % uWidth, i / uWidth), 0).rg);\n"
+    "  float db = mag > 0.0 ? 20.0 * log2(mag) * 0.30102999566 : 0.0;\n"
+    "  float s = db * uSmoothing + (1.0 - uSmoothing) * texelFetch(uPrev, ivec2(i, 0), 0).r;\n"
+    "  finalColor = vec4(s, s, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *gpu_fft_reduce_fs =
+    "#version 330\n"
+    "out vec4 finalColor;\n"
+    "uniform sampler2D uSrc;\n"
+    "uniform int uCount;\n"
+    "void main()\n"
+    "{\n"
+    "  int first = int(gl_FragCoord.x) * 16;\n"
+    "  vec2 range = texelFetch(uSrc, ivec2(first, 0), 0).rg;\n"
+    "  for (int i = first + 1; i < min(first + 16, uCount); i++)\n"
+    "  {\n"
+    "    vec2 v = texelFetch(uSrc, ivec2(i, 0), 0).rg;\n"
+    "    range = vec2(min(range.x, v.x), max(range.y, v.y));\n"
+    "  }\n"
+    "  finalColor = vec4(range, 0.0, 1.0);\n"
+    "}\n";
+
+// Remaps like fft_postprocess() but to 0..1 instead of 0..255, what sampling the 8 bit texture gives
+static const char *gpu_fft_out_fs =
+    "#version 330\n"
+    "out vec4 finalColor;\n"
+    "uniform sampler2D uSmooth;\n"
+    "uniform sampler2D uRange;\n"
+    "uniform sampler2D uAmp;\n"
+    "void main()\n"
+    "{\n"
+    "  int i = int(gl_FragCoord.x);\n"
+    "  vec2 range = texelFetch(uRange, ivec2(0, 0), 0).rg;\n"
+    "  float s = texelFetch(uSmooth, ivec2(i, 0), 0).r;\n"
+    "  float fft = range.y > range.x ? (s - range.x) / (range.y - range.x) : 0.0;\n"
+    "  float amp = clamp(texelFetch(uAmp, ivec2(i, 0), 0).r * 0.5 + 0.5, 0.0, 1.0);\n"
+    "  finalColor = vec4(fft, amp, 0.0, 1.0);\n"
+    "}\n";
+
+static RenderTexture2D gpu_fft_target(int width, int height)
+{
+  RenderTexture2D target = {0};
+  target.id = rlLoadFramebuffer(width, height);
+  if (target.id == 0)
+    return target;
+  target.texture.id = rlLoadTexture(NULL, width, height, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
+  target.texture.width = width;
+  target.texture.height = height;
+  target.texture.mipmaps = 1;
+  target.texture.format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+  rlFramebufferAttach(target.id, target.texture.id, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+  if (target.texture.id == 0 || !rlFramebufferComplete(target.id))
+  {
+    UnloadRenderTexture(target);
+    target.id = 0;
+    return target;
+  }
+  BeginTextureMode(target); // The storage is uninitialized, the smoothing reads the previous frame
+  ClearBackground(BLANK);
+  EndTextureMode();
+  return target;
+}
+
+static Texture2D gpu_fft_float_texture(int width, int height)
+{
+  Texture2D texture = {0};
+  texture.id = rlLoadTexture(NULL, width, height, PIXELFORMAT_UNCOMPRESSED_R32, 1);
+  texture.width = width;
+  texture.height = height;
+  texture.mipmaps = 1;
+  texture.format = PIXELFORMAT_UNCOMPRESSED_R32;
+  return texture;
+}
+
+// Draws a quad over the whole target with `shader`, the samplers have to be set after BeginShaderMode()
+static void gpu_fft_begin(RenderTexture2D target, Shader shader)
+{
+  BeginTextureMode(target);
+  BeginShaderMode(shader);
+}
+
+static void gpu_fft_end(RenderTexture2D target)
+{
+  DrawRectangle(0, 0, target.texture.width, target.texture.height, WHITE);
+  EndShaderMode();
+  EndTextureMode();
+}
+
+void gpu_fft_unload(GpuFft *g)
+{
+  UnloadTexture(g->input);
+  UnloadTexture(g->amp);
+  for (int i = 0; i < 2; i++)
+  {
+    UnloadRenderTexture(g->work[i]);
+    UnloadRenderTexture(g->smooth[i]);
+  }
+  for (int i = 0; i < g->reduce_count; i++)
+    UnloadRenderTexture(g->reduce[i]);
+  UnloadRenderTexture(g->output);
+  UnloadShader(g->pass_shader);
+  UnloadShader(g->mag_shader);
+  UnloadShader(g->reduce_shader);
+  UnloadShader(g->out_shader);
+  memset(g, 0, sizeof(*g));
+}
+
+// Needs a GL context, returns false (and leaves `g` zeroed) if float render targets or the shaders are not available
+bool gpu_fft_init(GpuFft *g, int n, int bins)
+{
+  memset(g, 0, sizeof(*g));
+  g->n = n;
+  g->bins = bins;
+  g->width = n < GPU_FFT_ROW ? n : GPU_FFT_ROW;
+  g->height = n / g->width;
+
+  g->pass_shader = LoadShaderFromMemory(NULL, gpu_fft_pass_fs);
+  g->mag_shader = LoadShaderFromMemory(NULL, gpu_fft_mag_fs);
+  g->reduce_shader = LoadShaderFromMemory(NULL, gpu_fft_reduce_fs);
+  g->out_shader = LoadShaderFromMemory(NULL, gpu_fft_out_fs);
+  // raylib falls back to its default shader when compiling fails
+  bool ok = g->pass_shader.id != rlGetShaderIdDefault() && g->mag_shader.id != rlGetShaderIdDefault() &&
+            g->reduce_shader.id != rlGetShaderIdDefault() && g->out_shader.id != rlGetShaderIdDefault();
+
+  g->input = gpu_fft_float_texture(g->width, g->height);
+  g->amp = gpu_fft_float_texture(bins, 1);
+  ok = ok && g->input.id != 0 && g->amp.id != 0;
+  for (int i = 0; i < 2; i++)
+  {
+    g->work[i] = gpu_fft_target(g->width, g->height);
+    g->smooth[i] = gpu_fft_target(bins, 1);
+    ok = ok && g->work[i].id != 0 && g->smooth[i].id != 0;
+  }
+  for (int count = bins; count > 1 && g->reduce_count < GPU_FFT_MAX_REDUCE; g->reduce_count++)
+  {
+    count = (count + GPU_FFT_REDUCE - 1) / GPU_FFT_REDUCE;
+    g->reduce[g->reduce_count] = gpu_fft_target(count, 1);
+    ok = ok && g->reduce[g->reduce_count].id != 0;
+  }
+  g->output = gpu_fft_target(bins, 1);
+  ok = ok && g->output.id != 0;
+  if (!ok)
+  {
+    fprintf(stderr, "ERROR: The GPU FFT needs float render targets, staying on the CPU\n");
+    gpu_fft_unload(g);
+    return false;
+  }
+  SetTextureFilter(g->output.texture, TEXTURE_FILTER_BILINEAR); // Like uBuffer
+  SetTextureWrap(g->output.texture, TEXTURE_WRAP_CLAMP);
+
+  g->pass_src_loc = GetShaderLocation(g->pass_shader, "uSrc");
+  g->pass_n_loc = GetShaderLocation(g->pass_shader, "uN");
+  g->pass_width_loc = GetShaderLocation(g->pass_shader, "uWidth");
+  g->pass_p_loc = GetShaderLocation(g->pass_shader, "uP");
+  g->pass_radix_loc = GetShaderLocation(g->pass_shader, "uRadix");
+  g->mag_spectrum_loc = GetShaderLocation(g->mag_shader, "uSpectrum");
+  g->mag_prev_loc = GetShaderLocation(g->mag_shader, "uPrev");
+  g->mag_width_loc = GetShaderLocation(g->mag_shader, "uWidth");
+  g->mag_smoothing_loc = GetShaderLocation(g->mag_shader, "uSmoothing");
+  g->reduce_src_loc = GetShaderLocation(g->reduce_shader, "uSrc");
+  g->reduce_count_loc = GetShaderLocation(g->reduce_shader, "uCount");
+  g->out_smooth_loc = GetShaderLocation(g->out_shader, "uSmooth");
+  g->out_range_loc = GetShaderLocation(g->out_shader, "uRange");
+  g->out_amp_loc = GetShaderLocation(g->out_shader, "uAmp");
+  g->ready = true;
+  return true;
+}
+
+// Transforms n windowed samples and updates the output from them, `amp` holds bins samples for .g
+// `smoothing` is the weight of the new spectrum like in fft_postprocess()
+void gpu_fft_run(GpuFft *g, const float *windowed, const float *amp, float smoothing)
+{
+  if (!g->ready)
+    return;
+  UpdateTexture(g->input, windowed);
+  UpdateTexture(g->amp, amp);
+
+  Texture2D src = g->input; // Real input, .g reads as 0
+  int dst = 0;
+  for (int p = 1; p < g->n;)
+  {
+    int radix = p * 4 <= g->n ? 4 : 2;
+    gpu_fft_begin(g->work[dst], g->pass_shader);
+    SetShaderValueTexture(g->pass_shader, g->pass_src_loc, src);
+    SetShaderValue(g->pass_shader, g->pass_n_loc, &g->n, SHADER_UNIFORM_INT);
+    SetShaderValue(g->pass_shader, g->pass_width_loc, &g->width, SHADER_UNIFORM_INT);
+    SetShaderValue(g->pass_shader, g->pass_p_loc, &p, SHADER_UNIFORM_INT);
+    SetShaderValue(g->pass_shader, g->pass_radix_loc, &radix, SHADER_UNIFORM_INT);
+    gpu_fft_end(g->work[dst]);
+    src = g->work[dst].texture;
+    g->work_cur = dst;
+    dst = 1 - dst;
+    p *= radix;
+  }
+
+  int prev = g->smooth_cur;
+  g->smooth_cur = 1 - prev;
+  gpu_fft_begin(g->smooth[g->smooth_cur], g->mag_shader);
+  SetShaderValueTexture(g->mag_shader, g->mag_spectrum_loc, g->work[g->work_cur].texture);
+  SetShaderValueTexture(g->mag_shader, g->mag_prev_loc, g->smooth[prev].texture);
+  SetShaderValue(g->mag_shader, g->mag_width_loc, &g->width, SHADER_UNIFORM_INT);
+  SetShaderValue(g->mag_shader, g->mag_smoothing_loc, &smoothing, SHADER_UNIFORM_FLOAT);
+  gpu_fft_end(g->smooth[g->smooth_cur]);
+
+  Texture2D range = g->smooth[g->smooth_cur].texture;
+  for (int i = 0; i < g->reduce_count; i++)
+  {
+    gpu_fft_begin(g->reduce[i], g->reduce_shader);
+    SetShaderValueTexture(g->reduce_shader, g->reduce_src_loc, range);
+    SetShaderValue(g->reduce_shader, g->reduce_count_loc, &range.width, SHADER_UNIFORM_INT);
+    gpu_fft_end(g->reduce[i]);
+    range = g->reduce[i].texture;
+  }
+
+  gpu_fft_begin(g->output, g->out_shader);
+  SetShaderValueTexture(g->out_shader, g->out_smooth_loc, g->smooth[g->smooth_cur].texture);
+  SetShaderValueTexture(g->out_shader, g->out_range_loc, range);
+  SetShaderValueTexture(g->out_shader, g->out_amp_loc, g->amp);
+  gpu_fft_end(g->output);
+}
+
+// Reads the last spectrum back as n interleaved re/im pairs, only for checking against the CPU
+bool gpu_fft_read_spectrum(GpuFft *g, float *re_im)
+{
+  float *pixels = (float *)rlReadTexturePixels(g->work[g->work_cur].texture.id, g->width, g->height, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32);
+  if (pixels == NULL)
+    return false;
+  for (int i = 0; i < g->n; i++)
+  {
+    re_im[2 * i] = pixels[4 * i];
+    re_im[2 * i + 1] = pixels[4 * i + 1];
+  }
+  free(pixels);
+  return true;
+}
+
+// Reads the output back as bins RGBA floats, only for checking against the CPU
+bool gpu_fft_read_output(GpuFft *g, float *rgba)
+{
+  float *pixels = (float *)rlReadTexturePixels(g->output.texture.id, g->bins, 1, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32);
+  if (pixels == NULL)
+    return false;
+  memcpy(rgba, pixels, (size_t)g->bins * 4 * sizeof(float));
+  free(pixels);
+  return true;
+}
@@ -0,0 +1,248 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "raylib.h"
+#include "rlgl.h"
+#include "external/glad.h" // Only the declarations, raylib loads the GL functions; rlgl has no pixel buffer objects
+
+// Audio generated by a shader, the other direction of Shadertoy's sound tab.
+// The sound shader defines `vec2 mainSound(int samp, float time)` (left/right in -1..1). Blocks of
+// GPU_SOUND_BLOCK frames are rendered into a float render target, one texel per frame, and read back with
+// glReadPixels() into a pixel buffer object, so the copy happens asynchronously. A fence marks when a block
+// has arrived; finished blocks are moved into a FIFO that the audio thread plays from. Blocks are rendered
+// GPU_SOUND_AHEAD ahead of the audio thread, with up to GPU_SOUND_PBOS readbacks in flight. That covers
+// many frames of GPU latency. An underrun (the audio thread finding the FIFO short) is counted, so a queue
+// that is too shallow shows up in the stats instead of as a click nobody notices.
+// NOTE: Needs float render targets and GL 3.2 fences (GL 3.3, also Mesa's llvmpipe).
+
+#define GPU_SOUND_ROW 1024       // Texels per row of the block texture (also hardcoded in gpu_sound_footer)
+#define GPU_SOUND_BLOCK 4096     // Frames rendered per pass, GPU_SOUND_ROW x 4 texels
+#define GPU_SOUND_PBOS 4         // Readbacks in flight at most
+#define GPU_SOUND_AHEAD 4        // Blocks kept queued in front of the audio thread (FIFO + in flight)
+#define GPU_SOUND_MAX_SUBMIT 2   // Blocks rendered per call of gpu_sound_update() at most
+#define GPU_SOUND_FIFO 32768     // Frames, power of two, holds GPU_SOUND_AHEAD + GPU_SOUND_PBOS blocks
+
+typedef struct gpu_sound_s
+{
+  bool ready;
+  char name[256];
+  unsigned int sample_rate;
+  RenderTexture2D target;
+  Shader shader;
+  int block_start_loc, sample_rate_loc;
+  unsigned int pbo[GPU_SOUND_PBOS];
+  GLsync fence[GPU_SOUND_PBOS];
+  double submit_time[GPU_SOUND_PBOS];
+  unsigned int head;     // Oldest readback in flight
+  unsigned int inflight; // Readbacks in flight
+  int next_sample;       // First frame of the next block to render
+  float *fifo;           // Interleaved stereo, GPU_SOUND_FIFO frames
+  volatile unsigned long long fifo_written; // Frames, written by the main thread
+  volatile unsigned long long fifo_read;    // Frames, written by the audio thread
+  volatile unsigned int underruns;          // Reads that found fewer frames than asked for
+  float readback;     // Seconds from rendering a block to it being in the FIFO, averaged
+  float readback_max; // Worst case since the stats were last reset
+  float queued_min;   // Fewest seconds queued in the FIFO since the stats were last reset
+} GpuSound;
+
+// Shadertoy style wrapper, `samp` counts frames from the start, `time` is in seconds
+static const char *gpu_sound_header =
+    "#version 330\n"
+    "out vec4 finalColor;\n"
+    "uniform int uBlockStart;\n"
+    "uniform float uSampleRate;\n"
+    "#line 1\n";
+static const char *gpu_sound_footer =
+    "\nvoid main()\n"
+    "{\n"
+    "  int samp = uBlockStart + int(gl_FragCoord.y) * 1024 + int(gl_FragCoord.x);\n"
+    "  finalColor = vec4(clamp(mainSound(samp, float(samp) / uSampleRate), -1.0, 1.0), 0.0, 1.0);\n"
+    "}\n";
+
+void gpu_sound_unload(GpuSound *g)
+{
+  for (unsigned int i = 0; i < g->inflight; i++)
+    glDeleteSync(g->fence[(g->head + i) % GPU_SOUND_PBOS]);
+  if (g->pbo[0] != 0)
+    glDeleteBuffers(GPU_SOUND_PBOS, g->pbo);
+  if (g->target.id != 0)
+    UnloadRenderTexture(g->target);
+  if (g->shader.id != 0)
+    UnloadShader(g->shader);
+  free(g->fifo);
+  memset(g, 0, sizeof(*g));
+}
+
+// `source` is the sound shader without #version, needs a GL context.
+// Returns false (and leaves `g` zeroed) if it doesn't compile or the GL features are missing.
+bool gpu_sound_init(GpuSound *g, const char *source, const char *name, unsigned int sample_rate)
+{
+  memset(g, 0, sizeof(*g));
+  strncpy(g->name, name, sizeof(g->name) - 1);
+  g->sample_rate = sample_rate;
+  size_t length = strlen(gpu_sound_header) + strlen(source) + strlen(gpu_sound_footer) + 1;
+  char *fs = (char *)malloc(length);
+  g->fifo = (float *)malloc(2 * GPU_SOUND_FIFO * sizeof(float));
+  if (fs == NULL || g->fifo == NULL)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    free(fs);
+    gpu_sound_unload(g);
+    return false;
+  }
+  snprintf(fs, length, "%s%s%s", gpu_sound_header, source, gpu_sound_footer);
+  g->shader = LoadShaderFromMemory(NULL, fs);
+  free(fs);
+  if (g->shader.id == rlGetShaderIdDefault()) // raylib falls back to its default shader when compiling fails
+  {
+    fprintf(stderr, "ERROR: The sound shader [%s] doesn't compile, it needs `vec2 mainSound(int samp, float time)`\n", name);
+    g->shader.id = 0;
+    gpu_sound_unload(g);
+    return false;
+  }
+  g->block_start_loc = GetShaderLocation(g->shader, "uBlockStart");
+  g->sample_rate_loc = GetShaderLocation(g->shader, "uSampleRate");
+
+  const int width = GPU_SOUND_ROW, height = GPU_SOUND_BLOCK / GPU_SOUND_ROW;
+  g->target.id = rlLoadFramebuffer(width, height);
+  g->target.texture.id = rlLoadTexture(NULL, width, height, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
+  g->target.texture.width = width;
+  g->target.texture.height = height;
+  g->target.texture.mipmaps = 1;
+  g->target.texture.format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+  if (g->target.id != 0 && g->target.texture.id != 0)
+    rlFramebufferAttach(g->target.id, g->target.texture.id, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+  if (g->target.id == 0 || g->target.texture.id == 0 || !rlFramebufferComplete(g->target.id))
+  {
+    fprintf(stderr, "ERROR: The sound shader needs float render targets\n");
+    gpu_sound_unload(g);
+    return false;
+  }
+
+  glGenBuffers(GPU_SOUND_PBOS, g->pbo);
+  for (int i = 0; i < GPU_SOUND_PBOS; i++)
+  {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, g->pbo[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, 2 * GPU_SOUND_BLOCK * sizeof(float), NULL, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  g->queued_min = -1.0f;
+  g->ready = true;
+  return true;
+}
+
+// Frames the audio thread can still play before it runs dry
+unsigned int gpu_sound_queued(const GpuSound *g)
+{
+  return (unsigned int)(g->fifo_written - g->fifo_read);
+}
+
+// Renders the next block and starts reading it back into the next free pixel buffer object
+static void gpu_sound_submit(GpuSound *g)
+{
+  unsigned int slot = (g->head + g->inflight) % GPU_SOUND_PBOS;
+  float rate = (float)g->sample_rate;
+  BeginTextureMode(g->target);
+  BeginShaderMode(g->shader);
+  SetShaderValue(g->shader, g->block_start_loc, &g->next_sample, SHADER_UNIFORM_INT);
+  SetShaderValue(g->shader, g->sample_rate_loc, &rate, SHADER_UNIFORM_FLOAT);
+  DrawRectangle(0, 0, g->target.texture.width, g->target.texture.height, WHITE);
+  EndShaderMode(); // Draws the batch
+  EndTextureMode();
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, g->target.id);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, g->pbo[slot]);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, g->target.texture.width, g->target.texture.height, GL_RG, GL_FLOAT, NULL); // Returns right away
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  g->fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush(); // Otherwise the fence might only be sent with the next buffer swap
+  g->submit_time[slot] = GetTime();
+  g->next_sample += GPU_SOUND_BLOCK;
+  g->inflight++;
+}
+
+// Moves the readbacks that are done into the FIFO, oldest first, never waits for the GPU
+static void gpu_sound_harvest(GpuSound *g)
+{
+  while (g->inflight > 0)
+  {
+    unsigned int slot = g->head;
+    GLenum status = glClientWaitSync(g->fence[slot], 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+      break;
+    glDeleteSync(g->fence[slot]);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, g->pbo[slot]);
+    const float *block = (const float *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 2 * GPU_SOUND_BLOCK * sizeof(float), GL_MAP_READ_BIT);
+    unsigned int start = (unsigned int)(g->fifo_written & (GPU_SOUND_FIFO - 1));
+    unsigned int first = GPU_SOUND_FIFO - start < GPU_SOUND_BLOCK ? GPU_SOUND_FIFO - start : GPU_SOUND_BLOCK;
+    if (block != NULL && status != GL_WAIT_FAILED)
+    {
+      memcpy(g->fifo + 2 * start, block, 2 * first * sizeof(float));
+      memcpy(g->fifo, block + 2 * first, 2 * (GPU_SOUND_BLOCK - first) * sizeof(float));
+    }
+    else // Lost, silence is better than stopping the clock
+    {
+      memset(g->fifo + 2 * start, 0, 2 * first * sizeof(float));
+      memset(g->fifo, 0, 2 * (GPU_SOUND_BLOCK - first) * sizeof(float));
+    }
+    if (block != NULL)
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    g->fifo_written += GPU_SOUND_BLOCK; // Published after the copy
+
+    float latency = (float)(GetTime() - g->submit_time[slot]);
+    g->readback = g->readback == 0.0f ? latency : 0.95f * g->readback + 0.05f * latency;
+    g->readback_max = latency > g->readback_max ? latency : g->readback_max;
+    g->head = (g->head + 1) % GPU_SOUND_PBOS;
+    g->inflight--;
+  }
+}
+
+// Main thread, once per frame: collects the finished blocks and renders new ones until GPU_SOUND_AHEAD
+// blocks are queued or in flight
+void gpu_sound_update(GpuSound *g)
+{
+  if (!g->ready)
+    return;
+  gpu_sound_harvest(g);
+  float queued = (float)gpu_sound_queued(g) / g->sample_rate;
+  if (g->queued_min < 0.0f || queued < g->queued_min)
+    g->queued_min = queued;
+  for (int i = 0; i < GPU_SOUND_MAX_SUBMIT && g->inflight < GPU_SOUND_PBOS; i++)
+  {
+    unsigned int pending = gpu_sound_queued(g) + g->inflight * GPU_SOUND_BLOCK;
+    if (pending >= GPU_SOUND_AHEAD * GPU_SOUND_BLOCK || pending + GPU_SOUND_BLOCK > GPU_SOUND_FIFO)
+      break;
+    gpu_sound_submit(g);
+  }
+}
+
+// Audio thread: copies up to `frames` stereo frames into `out`, fills the rest with silence
+unsigned int gpu_sound_read(GpuSound *g, float *out, unsigned int frames)
+{
+  unsigned int available = gpu_sound_queued(g);
+  unsigned int n = available < frames ? available : frames;
+  unsigned int start = (unsigned int)(g->fifo_read & (GPU_SOUND_FIFO - 1));
+  unsigned int first = GPU_SOUND_FIFO - start < n ? GPU_SOUND_FIFO - start : n;
+  memcpy(out, g->fifo + 2 * start, 2 * first * sizeof(float));
+  memcpy(out + 2 * first, g->fifo, 2 * (n - first) * sizeof(float));
+  g->fifo_read += n;
+  if (n < frames)
+  {
+    memset(out + 2 * n, 0, 2 * (frames - n) * sizeof(float));
+    g->underruns++;
+  }
+  return n;
+}
+
+// Starts a new window for the worst case values
+void gpu_sound_reset_stats(GpuSound *g)
+{
+  g->readback_max = 0.0f;
+  g->queued_min = -1.0f;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "rlgl.h"
+#include "external/glad.h" // Only the declarations, raylib loads the GL functions; rlgl has no queries
+
+// GPU time of a series of draws with GL_TIME_ELAPSED queries (GL 3.3, also on Mesa's llvmpipe). Every
+// gpu_timer_begin()/gpu_timer_end() pair uses its own query, the results are only collected at the end, so
+// measuring doesn't stall the pipeline in between. gpu_timer_collect() waits for the GPU (benchmarks),
+// gpu_timer_poll() doesn't, it's for measuring while drawing with a few timers in turn. Whatever raylib still has batched has to be flushed
+// (rlDrawRenderBatchActive()) right after begin and before end, otherwise the draw lands outside the pair.
+
+typedef struct gpu_timer_s
+{
+  bool supported;
+  unsigned int *queries;
+  unsigned int count; // Pairs there are queries for
+  unsigned int used;
+  bool active;
+} GpuTimer;
+
+void gpu_timer_free(GpuTimer *t)
+{
+  if (t->queries != NULL && t->supported)
+    glDeleteQueries((GLsizei)t->count, t->queries);
+  free(t->queries);
+  memset(t, 0, sizeof(*t));
+}
+
+// Room for `count` measurements. Returns false if there are no timer queries (the timer does nothing then).
+bool gpu_timer_init(GpuTimer *t, unsigned int count)
+{
+  memset(t, 0, sizeof(*t));
+  t->supported = rlGetVersion() == RL_OPENGL_33 || rlGetVersion() == RL_OPENGL_43;
+  if (!t->supported)
+    return false;
+  t->queries = (unsigned int *)malloc(count * sizeof(unsigned int));
+  if (!t->queries)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    t->supported = false;
+    return false;
+  }
+  t->count = count;
+  glGenQueries((GLsizei)count, t->queries);
+  return true;
+}
+
+void gpu_timer_begin(GpuTimer *t)
+{
+  if (!t->supported || t->used >= t->count)
+    return;
+  glBeginQuery(GL_TIME_ELAPSED, t->queries[t->used]);
+  t->active = true;
+}
+
+void gpu_timer_end(GpuTimer *t)
+{
+  if (!t->active)
+    return;
+  glEndQuery(GL_TIME_ELAPSED);
+  t->active = false;
+  t->used++;
+}
+
+// Waits for the measurements and writes them to `seconds` (one per begin/end pair), returns how many there are
+unsigned int gpu_timer_collect(GpuTimer *t, double *seconds)
+{
+  for (unsigned int i = 0; i < t->used; i++)
+  {
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(t->queries[i], GL_QUERY_RESULT, &ns); // Blocks until it's available
+    seconds[i] = (double)ns * 1e-9;
+  }
+  unsigned int used = t->used;
+  t->used = 0;
+  return used;
+}
+
+// Like gpu_timer_collect() but doesn't wait: returns 0 and keeps the measurements while any of them is pending
+unsigned int gpu_timer_poll(GpuTimer *t, double *seconds)
+{
+  if (t->used == 0 || t->active)
+    return 0;
+  for (unsigned int i = 0; i < t->used; i++)
+  {
+    GLint available = 0;
+    glGetQueryObjectiv(t->queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      return 0;
+  }
+  return gpu_timer_collect(t, seconds);
+}
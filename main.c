@@ -6,34 +6,107 @@
  *   unnecessary complexity with little improvement in quality.
  * - I think the fft part is not working on MAC because it doesn't support complex floats
  */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L // For the POSIX parts (mmap, ftruncate, ...) with -std=c99
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <math.h>
 #include <complex.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include "raylib.h"
 #include "raymath.h"
 #define RAYGUI_IMPLEMENTATION
 #include "raygui.h"
 #include "style_dark.h"
-#include "queue.h"
+#include "playlist.h"
+#include "pcm_buffer.h"
+#include "capture.h"
+#include "gpu_fft.h"
+#include "cqt.h"
+#include "filterbank.h"
+#include "pitch.h"
+#include "scope.h"
+#include "resample.h"
+#include "tracker.h"
+#include "gpu_sound.h"
+#include "frame_block.h"
+#include "shader_pp.h"
+#include "rlgl.h"
+#include "analysis_shm.h"
+#include "gpu_timer.h"
+#include "normalizer.h"
+#include "replay.h"
+#include "plugin_host.h"
 
 // "Settings"
 
 /*
 typical samplerate = 44100 Hz f_nyquist = 22500 kHz because human hearing is around 20 Hz - 20 kHz
-bin width of fft = samplig frequency / NFFT which is around 5.384 Hz
+For visualisation we dont really need the frequencies at really high frequencies, so the window is
+resampled to ANALYSIS_RATE first, whatever the input rate is
+bin width of fft = ANALYSIS_RATE / NFFT which is around 5.384 Hz
 the positive frequencies are in the first half so 0..NFFT/2 - 1
-For visualisation we dont really need the frequencies at really high frequencies
 For example 1024*5.384 = 5513.216
-            2048*5.384 = 11026.432 which is more than enough
+            2048*5.384 = 11026.432 which is the whole band
 */
 
 #define DEBUG_MODE 0
 #define BUFFER_SIZE 2048
-#define NFFT 8192
+#define NFFT 4096
+#define ANALYSIS_RATE 22050.0f // Sample rate of the FFT input, the ring is decimated to it
 #define MAX_STRING_LEN 256
+#define PRELOAD_SECONDS 5.0f // How long before the end of a track the next one gets opened and pre-decoded
+#define RING_SIZE 65536      // Sample history, power of two, has to hold the decimator input (NFFT at 192 kHz) plus the output latency
+#define DEVICE_CHANNELS 2    // raylib hands the stream processors float frames with AUDIO_DEVICE_CHANNELS channels
+#define DEVICE_PERIODS 3     // miniaudio's default period count, used to estimate how much audio is queued in the device
+#define LATENCY_STEP 0.005f  // Seconds per [ / ] press
+#define STATS_WINDOW 2.0     // Seconds over which the worst case values of the stats overlay are collected
+#define FACTOR 8             // Smoothing of the spectrum, multiplied with the frame time
+#define NORM_LOW_PERCENTILE 0.05f  // of the recent spectrum values, mapped to 0 in uBuffer
+#define NORM_HIGH_PERCENTILE 0.95f // mapped to 1
+#define NORM_MIN_RANGE 24.0f       // dB, so silence isn't stretched over the whole range
+#define NORM_HALF_LIFE 3.0f        // Seconds after which a spectrum value counts half as much (--norm-half-life)
+#define BENCH_FPS 60.0f      // uTime steps of the shader benchmark
+#define BENCH_WARMUP 10      // Unmeasured frames before every benchmark run
+#define BENCH_MAX_SHADERS 64
+#define LOW_POWER_FPS 20     // Frame rate while paused, minimized or hidden (keys are polled at it, 20 still catches quick taps)
+#define LOW_POWER_DELAY 1.0  // Seconds after the last mouse activity before dropping to it
+#define UI_BAR_GRANULE 256   // The control bar texture grows in steps of this many pixels, so resizing rarely reallocates it
+#define CQT_BINS 108         // Semitones, 9 octaves from CQT_MIN_FREQ
+#define CQT_MIN_FREQ 27.5f   // A0
+#define ZOOM_BINS 512        // Points of the chirp-Z zoom band
+#define FILTERBANK_BANDS 48  // Biquad bands between FILTERBANK_LOW and FILTERBANK_HIGH
+#define FILTERBANK_LOW 30.0f
+#define FILTERBANK_HIGH 16000.0f
+#define FILTERBANK_FLOOR_DB -60.0f // The band energies are mapped from this to 0 dBFS
+#define CHROMA_LOW 100.0f    // Below this the FFT bins are wider than a semitone
+#define CHROMA_HIGH 5000.0f
+#define PITCH_LOW 40.0f      // Search range of the pitch tracker in Hz
+#define PITCH_HIGH 2000.0f
+#define SCOPE_SEARCH 2048    // How many samples back the waveform may start to line up with the trigger
+#define TRACKER_FLASH 0.1f   // Seconds the note-on texels of the tracker row take to fade out
+#define SOUND_RATE 48000     // Sample rate sound shaders are rendered at
+#define BEAT_BANDS 4         // Lowest filterbank bands that make up uFrame.bass
+#define BEAT_THRESHOLD 1.3f  // A beat is the bass rising this much above its average
+#define BEAT_HOLD 0.15f      // Seconds after a beat before the next one can trigger
+#define DEFAULT_SHADER "shaders/test.frag"
+#define FONT_FILE "anita_semi_square.ttf"
+#define FONT_SIZE 28
+#define FONT_GLYPHS 95       // ASCII 32..126, the set LoadFontEx() rasterizes without a codepoint list
+#define FONT_PADDING 4       // Around every glyph in the atlas, the same as LoadFontEx()
+#define VISUALS_INTERVAL 30.0f  // Default seconds per shader of the visuals playlist
+#define VISUALS_FADE 2.0f       // Default seconds of the crossfade to the next one
+#define VISUALS_WARM_SIZE 256   // Pixels of the first draw that makes the driver finish compiling the next shader, it's
+                                // timed too, big enough that the fixed cost of a draw doesn't dominate
+#define VISUALS_FADE_SHARE 0.5f // Of the frame budget the incoming shader may take during the fade
+#define STARTUP_TARGET_MS 500.0f // Time to the first frame that counts as a regression (--ttff-target)
+#define OUTPUT_MAX 16            // Viewports of --outputs
+#define OUTPUT_TIMERS 3          // Frames an output's GPU time may be in flight, a frame whose timer is still pending isn't measured
+#define PLUGIN_BUDGET_MS 2.0f    // Average time per hop an analysis plugin may take before it's throttled (--plugin-budget)
 #ifndef PI
 #define PI 3.14159265358979323846f
 #endif
@@ -46,12 +119,37 @@ typedef unsigned int u32;
 typedef int i32;
 // Structs
 
+enum shader_quality_enum // Quality tiers of the visual shaders, the QUALITY define of the compiled variant
+{
+  QUALITY_LOW = 0,
+  QUALITY_MEDIUM,
+  QUALITY_HIGH,
+  QUALITY_COUNT,
+};
+
+typedef struct ui_bar_state_s // Everything the control bar is drawn from, it's only redrawn when this changes
+{
+  Vector2 window_size;
+  Vector2 mouse; // Only while it's over the bar or a button is involved, moving over the canvas doesn't count
+  i32 buttons;   // Left button down, pressed and released this frame
+  bool loaded;
+  bool playing;
+  i32 progress; // Position of the slider in pixels
+  char label[MAX_STRING_LEN];
+} UiBarState;
+
 typedef struct ui_struct // Holds information about the UI
 {
   Vector2 window_size;
-  Shader shader;
+  Shader shader; // The variant that is drawn with
   char shader_filepath[MAX_STRING_LEN];
-  Texture canvas;
+  Shader shader_variants[QUALITY_COUNT]; // shader_filepath compiled per quality tier, id 0 until it's first used
+  ShaderSource shader_source;            // shader_filepath read and preprocessed, the variants only differ in the prelude
+  u32 quality;                           // Tier that is drawn with, cycled with [ V ]
+  f32 shader_rate;                       // SAMPLE_RATE the variants were compiled with
+  RenderTexture2D bar; // Cached control bar, at least as big as the bar (UI_BAR_GRANULE steps)
+  UiBarState bar_state; // It was last drawn with
+  u32 bar_redraws;
   char music_name[MAX_STRING_LEN];
   Rectangle canvas_bounds;
   Rectangle music_name_bounds;
@@ -61,33 +159,294 @@ typedef struct ui_struct // Holds information about the UI
   Rectangle volume_hover_bounds;
   Rectangle volume_slider_bounds;
   bool volume_hovered;
-  Queue music_queue;
+  bool show_stats; // Stats overlay, toggled with [ I ]
+  f32 seek_secs; // Last position the progress bar was dragged to, so we only seek when it changes
+  bool run_self_check; // --gpu-fft-selftest, compares the GPU FFT with fft() and exits
+  bool run_sound_check; // --sound-selftest, plays a sine sound shader through the readback pipeline and exits
+  Playlist playlist;
 } UI;
 
+enum analysis_row_enum // Rows of uAnalysis
+{
+  ANALYSIS_ROW_CQT = 0, // Constant-Q magnitudes, one texel per semitone from CQT_MIN_FREQ
+  ANALYSIS_ROW_ZOOM,    // Chirp-Z zoom, ZOOM_BINS texels linearly spaced over the zoom band
+  ANALYSIS_ROW_BANDS,   // Filterbank energies, FILTERBANK_BANDS texels, updated every device period
+  ANALYSIS_ROW_CHROMA,  // Pitch class energies C..B relative to the strongest one, CPU analysis only
+  ANALYSIS_ROW_TRACKER, // Per channel levels, notes and note-ons of .xm/.mod modules, TRACKER_MAX_CHANNELS texels each
+  ANALYSIS_ROWS,
+};
+typedef char analysis_shm_fits[ANALYSIS_ROWS <= ANALYSIS_SHM_ROWS && BUFFER_SIZE == ANALYSIS_SHM_BINS ? 1 : -1]; // publish_update() copies whole rows
+
+enum frame_mode_enum // What the frame scheduler did with the last frame
+{
+  FRAME_MODE_DISPLAY = 0, // Analysis and drawing at the refresh rate of the monitor
+  FRAME_MODE_IDLE,        // Drawing at the refresh rate, the analysis is skipped because the window didn't move
+  FRAME_MODE_LOW_POWER,   // Paused, minimized or hidden, LOW_POWER_FPS
+  FRAME_MODE_BENCHMARK,   // Uncapped with vsync off and the analysis every frame, --benchmark or [ B ]
+  FRAME_MODE_COUNT,
+};
+
+typedef struct bench_struct // --shader-bench, renders shaders offscreen and reports their GPU time
+{
+  bool run;
+  const char *shaders[BENCH_MAX_SHADERS]; // --bench-shader, all of shaders/*.frag without
+  u32 shader_count;
+  const char *sizes; // "WxH,WxH,..."
+  u32 frames;        // Measured per shader and size
+  const char *out;   // .csv or .json
+  const char *input; // WAV uBuffer is computed from, a synthetic signal without
+  f32 budget_ms;     // Fails if a median frame takes longer, 0 is no budget
+} Bench;
+
+typedef struct scheduler_struct
+{
+  u32 mode;
+  bool benchmark;
+  i32 monitor;       // The window was on when display_fps was queried
+  i32 display_fps;   // Refresh rate of that monitor
+  i32 target_fps;    // Passed to SetTargetFPS(), 0 is uncapped
+  u32 frames;        // Since stats_reset
+  u32 analysed;
+  double stats_reset;
+  double last_input; // Mouse moved or a button was held
+  f32 fps;           // Achieved over the last STATS_WINDOW
+  f32 analysis_fps;
+} Scheduler;
+
+typedef struct shader_locs_struct // Locations of the loose uniforms in one compiled shader
+{
+  i32 u_buffer_loc;
+  i32 u_analysis_loc;
+  i32 u_time_loc;
+  i32 u_song_time_loc;
+  i32 u_pitch_loc;
+  i32 u_scope_offset_loc;
+  i32 u_resolution_loc;
+  i32 u_plugins_loc;
+  i32 u_plugin_values_loc;
+} ShaderLocs;
+
+enum visuals_state_enum // Where the next shader of the visuals playlist is
+{
+  VISUALS_IDLE = 0, // Nothing prepared
+  VISUALS_READING,  // Read and preprocessed on a worker, compiled on the first frame after
+  VISUALS_WARMING,  // Compiled, drawn once offscreen on the next frame
+  VISUALS_READY,    // Waiting for the timer, a beat or [ TAB ]
+  VISUALS_FADING,   // Crossfading to it
+};
+
+typedef struct visuals_struct // Shader playlist, the next shader is compiled and warmed up long before it's switched to
+{
+  Playlist shaders;  // --visuals, `current` is the one drawn
+  f32 interval;      // --visuals-interval, seconds per shader (0 is off)
+  u32 beats;         // --visuals-beats, beats per shader (0 is off)
+  f32 fade;          // --visuals-fade, seconds
+  u32 state;
+  u32 next;          // Index of the prepared shader
+  u32 failed;        // Shaders in a row that couldn't be read, the preparation stops when all of them failed
+  pthread_t thread;  // Reads next_source
+  bool thread_running;
+  volatile bool read_done;
+  ShaderSource next_source;
+  Shader next_shader;
+  ShaderLocs next_locs;
+  u32 next_quality;  // The tier and rate next_shader was compiled with
+  f32 next_rate;
+  RenderTexture2D target; // The incoming shader is drawn into it and blended over the outgoing one, canvas sized
+  bool requested;    // Switch as soon as the next one is ready
+  double shown;      // GetTime() the current one started
+  u32 beats_shown;
+  double last_beat;  // audio.beat_time that was counted last
+  f32 progress;      // Of the fade, 0..1
+  f32 scale;         // Resolution the incoming shader is drawn at during the fade, halved when a frame goes over budget
+  GpuTimer warm_timer; // GPU time of the warm-up draw, read without waiting while it's ready
+  f32 warm_ms;       // Of the warm-up draw, 0 while it isn't known
+  f32 start_scale;   // The fade started with, picked from warm_ms
+  u32 fade_frames;
+  u32 over_budget;   // Frames of the last fade that took longer than the budget
+  f32 fade_max;      // Longest frame of the last fade in seconds
+  f32 budget;        // It was measured against
+} Visuals;
+
+typedef struct output_struct // One viewport of the canvas
+{
+  Rectangle bounds;      // In the window
+  Rectangle wall;        // Part of the canvas a tile shows, the source rect in texture coordinates (y up, flipped)
+  ShaderSource source;   // --output-shader, empty for a tile of the main shader
+  Shader shader;         // source compiled with quality and rate, id 0 until it's first drawn
+  ShaderLocs locs;
+  u32 quality;
+  f32 rate;
+  GpuTimer timers[OUTPUT_TIMERS]; // One query each, used in turn and read once the GPU is done with them
+  u32 frame;             // Drawn, picks the timer
+  f32 gpu_ms;            // Averaged
+  f32 gpu_ms_max;        // Over the last STATS_WINDOW
+} Output;
+
+typedef struct outputs_struct // --outputs, the canvas split into a grid of viewports (one per display of a wall)
+{
+  u32 cols, rows;
+  u32 count;   // cols * rows, 0 draws the canvas as a whole
+  f32 gap;     // --output-gap, pixels between the viewports (the bezels), the tiles' image continues behind them
+  Output outputs[OUTPUT_MAX];
+} Outputs;
+
+typedef struct startup_struct // The CPU side of the initialization runs on workers while the window is created
+{
+  double start;            // startup_clock() at the top of main()
+  pthread_t audio_thread;  // InitAudioDevice(), connecting to the sound server takes a while
+  pthread_t font_thread;   // Rasterizing the glyphs and packing the atlas
+  pthread_t assets_thread; // Decoding the icon, reading and preprocessing the default shader
+  bool audio_started, font_started, assets_started; // Until startup_join()
+  f32 window_ms, audio_ms, font_ms, assets_ms;
+  Image icon;
+  GlyphInfo *glyphs;   // FONT_GLYPHS of them, NULL if the font couldn't be loaded
+  Rectangle *recs;
+  Image atlas;         // Uploaded by the main thread
+  ShaderSource shader; // Taken by the first reload_shader() of the same file
+  f32 first_frame_ms;  // 0 until the first frame is presented
+  f32 target_ms;       // --ttff-target
+  bool check;          // --ttff-check, quits after the first frame and fails if it took longer than target_ms
+} Startup;
+
+typedef struct replay_struct // --record and --replay, a log of the audio blocks and the frame inputs (replay.h)
+{
+  ReplayLog log;
+  const char *record_path;
+  const char *replay_path;
+  bool recording;   // ring_push_frames() queues every block it gets
+  bool replaying;   // clock_time(), clock_frame_time() and the audible position come from the log
+  double time;      // Of the record being replayed
+  f32 frame_time;   // Of the frame being replayed, as it was recorded
+  f32 song_time;
+  f32 latency;
+  // The inputs as of the last logged frame, record_frame() logs the ones that changed
+  Vector2 size;
+  char shader[MAX_STRING_LEN];
+  u32 quality;
+  char track[MAX_STRING_LEN];
+  f32 rate;
+  bool paused;
+  u32 frames;
+  const char *out; // --replay-out, .csv with a line per frame
+  f32 budget_ms;   // --replay-budget, fails if the 95th percentile frame takes longer, 0 is no budget
+} Replay;
+
 typedef struct audio_struct
 {
   Music music;
   Color pixel_buffer[BUFFER_SIZE];
   u32 current_frame;
   bool audio_loaded;
-  i32 audio_flag; // We need this flag to know when an audio is over
+  bool paused; // Set by the user, so a stopped stream can be told apart from a paused one
+  // Gapless playback: the next queued track is opened on a worker thread and its stream buffers are filled
+  // before the current one ends, so switching is just PlayMusicStream() on an already decoded stream
+  Music next_music;
+  char next_path[MAX_STRING_LEN];
+  pthread_t preload_thread;
+  volatile i32 preload_state;
+  // Decoded playback: the whole track is decoded into memory and played through a callback stream,
+  // seeking is just moving the cursor and the analysis window can be refilled right away
+  bool decode_mode; // Decode the tracks that get loaded from now on, toggled with [ D ]
+  bool decoded;     // The current track is played from decoded_pcm
+  PcmBuffer decoded_pcm[2]; // The current and the preloaded track
+  volatile i32 decoded_cur; // Index of the current track in decoded_pcm, the audio thread flips it at a gapless switch
+  volatile size_t decoded_cursor;
+  volatile size_t decoded_seek_frame;
+  volatile i32 decoded_seek_track; // decoded_cur the seek was computed for, a seek into the track before a switch is dropped
+  volatile u32 decoded_seek_seq; // Bumped by the main thread, the audio thread applies the seek when it differs from done
+  volatile u32 decoded_seek_done;
+  volatile bool decoded_next_ready; // The audio thread may continue with the preloaded track
+  volatile bool decoded_switched;   // It did, the main thread has to catch up
+  volatile bool decoded_finished;
+  // Every sample handed to the device goes into the ring, the analysis window is read from it
+  // at the position that is actually being heard right now (the write position minus the output latency)
+  f32 ring[RING_SIZE];
+  volatile unsigned long long ring_written; // Total samples pushed
+  volatile unsigned long long ring_cb_written; // ring_written at the end of the last callback
+  volatile double ring_cb_time;                // GetTime() of the last callback
+  volatile u32 period_frames;                  // Frames per callback, i.e. the device period
+  f32 device_rate;                             // Measured rate of the callbacks (the device sample rate)
+  unsigned long long rate_frames;
+  double rate_time;
+  f32 latency;        // Estimated output latency in seconds (device periods)
+  f32 latency_offset; // Manual correction on top of it, adjusted with [ and ]
+  // Live input, replaces the music as the source of the ring while it's active
+  Capture capture;
+  u32 capture_period;            // Requested period size in frames (--period)
+  double window_cb_time;         // ring_cb_time of the newest sample in the current analysis window
+  f32 capture_latency;           // Capture to pixel, averaged
+  f32 capture_latency_max;       // Worst case over the last STATS_WINDOW seconds
+  f32 capture_latency_max_shown;
+  double capture_latency_reset;
+  bool gpu_fft; // Analysis backend, the spectrum is computed in shader passes, toggled with [ G ]
+  GpuFft gpu;
+  // Musically spaced analysis, rows of uAnalysis, toggled with [ Q ]
+  bool cqt_enabled;
+  Cqt cqt;
+  Czt czt;
+  f32 zoom_low; // Band of the chirp-Z zoom in Hz (--zoom)
+  f32 zoom_high;
+  Filterbank bank; // Runs on the audio thread, always on
+  Scope scope;     // Picks the waveform segment in amp_buffer, cycled with [ O ]
+  Tracker *volatile tracker; // Shadow player of the current module, advanced by the audio thread, NULL for other tracks
+  u32 tracker_seen[TRACKER_MAX_CHANNELS]; // Note-on counters of the last frame
+  f32 tracker_flash[TRACKER_MAX_CHANNELS];
+  unsigned long long window_end; // Ring position of the newest sample in the current analysis window
+  bool window_stale;             // The analysis has to run even if the window didn't move (refilled ring, other settings)
+  // Sound shader, replaces the music as the source while it's ready
+  GpuSound sound;
+  AudioStream sound_stream;
+  double sound_stats_reset;
+  // Frame features for uFrame
+  f32 level;
+  f32 bass;
+  f32 bass_avg;
+  f32 beat;
+  double beat_time;
+  AnalysisShm publish; // --publish, the analysis frames for other processes
+  ChromaMap chroma_map;
+  Yin yin;
+  f32 chroma_smooth[CHROMA_CLASSES];
+  f32 analysis[ANALYSIS_ROWS][BUFFER_SIZE];
+  f32 analysis_smooth[ANALYSIS_ROWS][BUFFER_SIZE];
+  // Analysis plugins (--plugin), their results as of the last one that came in
+  f32 plugin_rows[PLUGIN_MAX][PLUGIN_ROW_SIZE];
+  f32 plugin_values[PLUGIN_MAX * PLUGIN_VALUES];
+  f32 plugin_samples[PLUGIN_SAMPLES]; // The newest samples of the window, copied out of the ring for them
+  unsigned long long hops;            // Analysed so far
+  Decimator decimator; // Ring rate to ANALYSIS_RATE, rebuilt when the stream rate changes
+  f32 decimator_in[RING_SIZE];
+  f32 scope_in[BUFFER_SIZE + SCOPE_SEARCH]; // The waveform is taken from the ring at its own rate
   fcplx fft_out[NFFT];
   f32 fft_in[NFFT];
   f32 fft_in_windowed[NFFT];
   f32 fft_smooth[BUFFER_SIZE];
+  Normalizer normalizer; // Range of fft_smooth that is mapped to uBuffer
+  f32 norm_half_life;
   f32 amp_buffer[BUFFER_SIZE];
 } Audio;
 
+enum preload_state_enum
+{
+  PRELOAD_IDLE = 0,
+  PRELOAD_LOADING, // LoadMusicStream() is running on the preload thread
+  PRELOAD_LOADED,  // The thread is done, but it wasn't joined yet
+  PRELOAD_READY,   // next_music is opened and its buffers are filled
+};
+
 typedef struct shader_uniforms_struct
 {
   Texture2D u_buffer;
+  Texture2D u_analysis; // Float, one row per analysis_row_enum
+  Texture2D u_plugins;  // Float, one row per plugin slot
   f32 u_time;
+  f32 u_song_time; // Position in the track that is audible right now, from the audio clock
+  Vector2 u_pitch;  // Fundamental frequency in Hz (0 if there is none) and how sure the tracker is (0..1)
+  f32 u_scope_offset; // Fraction of a sample the trigger point lies after the start of the waveform
   Vector2 u_resolution;
-
-  i32 u_buffer_loc;
-  i32 u_time_loc;
-  i32 u_resolution_loc;
-
+  FrameBlock frame_block; // uFrame, everything that isn't a texture in one uniform buffer
+  ShaderLocs locs;        // Of ui.shader
 } ShaderUniforms;
 
 // Some MACROS
@@ -98,26 +457,121 @@ typedef struct shader_uniforms_struct
 #define RadToDeg(x) (180.0 * (x) / PI)  // Convert radians to degrees
 #define DEBUG_SEGFAULT printf("Passed line : %d\n", __LINE__);
 
+static const char *scope_trigger_names[SCOPE_TRIGGER_COUNT] = {"none", "edge", "xcorr"};
+static const char *shader_quality_names[QUALITY_COUNT] = {"low", "medium", "high"};
+static const char *frame_mode_names[FRAME_MODE_COUNT] = {"display", "idle", "low power", "benchmark"};
+static const char *visuals_state_names[] = {"idle", "reading", "warming up", "ready", "fading"};
+
 // Module variables so I dont have to pass every struct around
 
 static Audio audio;
 static UI ui;
 static ShaderUniforms shader_uniforms;
+static Scheduler scheduler;
+static Startup startup = {.target_ms = STARTUP_TARGET_MS};
+static Visuals visuals = {.interval = VISUALS_INTERVAL, .fade = VISUALS_FADE};
+static Replay replay;
+static PluginHost plugins;
+static Outputs outputs;
+static Bench bench = {.sizes = "640x360,1280x720,1920x1080", .frames = 120, .out = "shader_bench.csv"};
 
 // Module functions
 
 void audio_callback(void *bufferData, u32 frames);
 static void push_buffers(f32 value);
+static void ring_push_frames(const f32 *samples, u32 frames, u32 channels);
+static void capture_sink(const f32 *frames, u32 frame_count, u32 channels);
+static void toggle_capture(CaptureKind kind, const char *wav_path);
+static void measure_capture_latency();
+static void parse_args(int argc, char **argv);
+static unsigned long long ring_window_end();
+static void ring_read_window(unsigned long long end);
+static void scheduler_update();
+static bool scheduler_analyse(unsigned long long window_end);
+static void ring_refill(const PcmBuffer *pcm, size_t frame);
+static f32 output_latency();
+static void stats_draw();
 static void load_audio(const char *file_path);
+static bool decode_track(const char *file_path, PcmBuffer *pcm);
+static void play_decoded();
+static void decoded_stream_callback(void *bufferData, u32 frames);
+static void audio_sync();
+static void unload_track();
+static void decoded_catch_up();
+static void track_update();
+static void track_replay();
+static f32 track_time_played();
+static f32 track_time_length();
+static void track_seek(f32 secs);
+static void *preload_thread_func(void *arg);
+static void preload_next_track();
+static void finish_preload();
+static void play_next_track();
+static void play_prev_track();
+static void cancel_preload();
 static void send_shader_uniforms();
 static void ui_draw();
 static void toggle_music_playing();
 static void resize_window();
+static void ui_bar_reserve(f32 width, f32 height);
+static void ui_bar_controls();
 static void check_dropped_files();
 static void reload_shader(const char *file_path);
+static void use_shader_variant(u32 quality);
+static Shader compile_shader_variant(const ShaderSource *source, u32 quality, f32 rate);
+static ShaderLocs shader_locs(Shader shader);
+static void set_shader_values(Shader shader, const ShaderLocs *locs, Vector2 resolution);
+static void unload_shader_variants();
 static void fft_prepare();
 static void fft(f32 *in, fcplx *out, u32 stride, u32 n);
 static void fft_postprocess();
+static void toggle_gpu_fft();
+static void toggle_cqt();
+static f32 stream_rate();
+static void analysis_update();
+static void constant_q_update(f32 rate, f32 *values);
+static void harmonic_update(f32 rate);
+static void analysis_row_update(u32 row, const f32 *values, u32 count);
+static void tracker_switch(const char *path, u32 sample_rate);
+static void tracker_update();
+static void features_update();
+static void publish_update();
+static bool start_sound_shader(const char *path);
+static void stop_sound_shader();
+static void sound_stream_callback(void *bufferData, u32 frames);
+static void sound_update();
+static bool gpu_sound_self_check();
+static bool gpu_fft_self_check();
+static bool shader_bench();
+static void upload_shader_uniforms(f32 delta_time);
+static void visuals_load(const char *path);
+static void visuals_update(Texture2D blank);
+static void visuals_draw(Texture2D blank);
+static void visuals_unload_next();
+static void visuals_free();
+static void *visuals_thread_func(void *arg);
+static double startup_clock();
+static void startup_begin();
+static void startup_join(pthread_t thread, bool *started);
+static void *startup_audio_func(void *arg);
+static void *startup_font_func(void *arg);
+static void *startup_assets_func(void *arg);
+static Font startup_font();
+static void startup_first_frame();
+static double clock_time();
+static f32 clock_frame_time();
+static f32 audible_song_time();
+static bool analysis_frame();
+static void ring_overwrite(const f32 *samples, u32 count);
+static void record_start(const char *path);
+static void record_frame();
+static void record_stop();
+static bool replay_run();
+static void plugins_update(bool analysed);
+static void outputs_layout();
+static void outputs_update();
+static void outputs_draw(Texture2D blank);
+static void outputs_free();
 // static f32 *load_wave_frames();
 // static void load_audio_buffers();
 
@@ -129,25 +583,29 @@ int main(int argc, char **argv)
 #if (DEBUG_MODE == 0)
   SetTraceLogLevel(LOG_WARNING);
 #endif
+  startup_begin(); // Only the GL uploads of what the workers prepare are left to the main thread
   SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT | FLAG_VSYNC_HINT);
+  double window_start = startup_clock();
   InitWindow(width, height, "CShaderSound");
+  startup.window_ms = (f32)((startup_clock() - window_start) * 1000.0);
   SetWindowMinSize(16 * 60, 9 * 60);
-  Image icon = LoadImage("icon.png");
-  SetWindowIcon(icon);
-  UnloadImage(icon);
-  InitAudioDevice();
-  SetMasterVolume(0.5f);
-  SetTargetFPS(60);
+  startup_join(startup.assets_thread, &startup.assets_started);
+  if (startup.icon.data != NULL)
+    SetWindowIcon(startup.icon);
+  UnloadImage(startup.icon);
+  SetTargetFPS(60); // Until scheduler_update() takes over in the main loop
   GuiLoadStyleDark();
-  const i32 font_size = 28;
-  Font font = LoadFontEx("anita_semi_square.ttf", font_size, NULL, 0);
+  const i32 font_size = FONT_SIZE;
+  startup_join(startup.font_thread, &startup.font_started);
+  Font font = startup_font();
   GuiSetFont(font);
-  GuiSetStyle(DEFAULT, TEXT_SIZE, 28);
+  GuiSetStyle(DEFAULT, TEXT_SIZE, font_size);
   GuiSetStyle(LABEL, TEXT_ALIGNMENT, TEXT_ALIGN_CENTER);
   GuiSetIconScale(2);
 
   // Initializing the UI struct
-  queue_init(&ui.music_queue);
+  srand((unsigned int)time(NULL)); // For playlist_shuffle()
+  playlist_init(&ui.playlist);
   ui.window_size = (Vector2){.x = (f32)width, .y = (f32)height};
   ui.canvas_bounds = (Rectangle){.x = 0, .y = 0, .width = ui.window_size.x, .height = ui.window_size.y * 0.8};
   ui.music_name_bounds = (Rectangle){.x = 0, .y = ui.window_size.y * 0.8, .width = ui.window_size.x, .height = ui.window_size.y * 0.1};
@@ -156,21 +614,13 @@ int main(int argc, char **argv)
   ui.skip_bounds = (Rectangle){.x = 0.1 * ui.window_size.x, .y = ui.window_size.y * 0.9, .width = ui.window_size.x * 0.1, .height = ui.window_size.y * 0.1};
   ui.volume_hover_bounds = (Rectangle){.x = 10.0, .y = 10.0, .width = 50.0, .height = 50.0};
   ui.volume_slider_bounds = (Rectangle){.x = 10.0, .y = 10.0, .width = 200.0, .height = 50.0};
-  Image tmp = GenImageColor(ui.canvas_bounds.width, ui.canvas_bounds.height, BLANK);
-  ui.canvas = LoadTextureFromImage(tmp);
-  UnloadImage(tmp);
-
-  strcpy(ui.shader_filepath, "shaders/test.frag");
-  ui.shader = LoadShader(0, ui.shader_filepath);
+  // Big enough for a maximized window, so resizing doesn't have to reallocate the control bar
+  i32 monitor = GetCurrentMonitor();
+  ui_bar_reserve(fmaxf(ui.window_size.x, (f32)GetMonitorWidth(monitor)), fmaxf(ui.window_size.y, (f32)GetMonitorHeight(monitor)) * 0.2f);
 
-  /*
-    uniform vec2 uResolution;
-    uniform float uTime;
-    uniform float uBuffer[BUFFER_SIZE];
-  */
-  shader_uniforms.u_resolution_loc = GetShaderLocation(ui.shader, "uResolution");
-  shader_uniforms.u_time_loc = GetShaderLocation(ui.shader, "uTime");
-  shader_uniforms.u_buffer_loc = GetShaderLocation(ui.shader, "uBuffer");
+  strcpy(ui.shader_filepath, DEFAULT_SHADER); // Compiled when there is something to draw, the arguments pick the quality
+  ui.quality = QUALITY_HIGH;
+  frame_block_init(&shader_uniforms.frame_block);
 
   // Initializing the ShaderUniorms struct
   shader_uniforms.u_time = 0.0f;
@@ -179,6 +629,15 @@ int main(int argc, char **argv)
   SetTextureFilter(shader_uniforms.u_buffer, TEXTURE_FILTER_BILINEAR); // Linear filtering
   SetTextureWrap(shader_uniforms.u_buffer, TEXTURE_WRAP_CLAMP);
   UnloadImage(temp);
+  Image rows = {.data = audio.analysis, .width = BUFFER_SIZE, .height = ANALYSIS_ROWS, .mipmaps = 1, .format = PIXELFORMAT_UNCOMPRESSED_R32};
+  shader_uniforms.u_analysis = LoadTextureFromImage(rows);
+  SetTextureFilter(shader_uniforms.u_analysis, TEXTURE_FILTER_POINT); // So the rows don't bleed into each other
+  SetTextureWrap(shader_uniforms.u_analysis, TEXTURE_WRAP_CLAMP);
+  Image plugin_rows = {.data = audio.plugin_rows, .width = PLUGIN_ROW_SIZE, .height = PLUGIN_MAX, .mipmaps = 1, .format = PIXELFORMAT_UNCOMPRESSED_R32};
+  shader_uniforms.u_plugins = LoadTextureFromImage(plugin_rows);
+  SetTextureFilter(shader_uniforms.u_plugins, TEXTURE_FILTER_POINT);
+  SetTextureWrap(shader_uniforms.u_plugins, TEXTURE_WRAP_CLAMP);
+  plugin_host_init(&plugins, PLUGIN_BUDGET_MS); // The workers start with the first --plugin
   shader_uniforms.u_resolution = (Vector2){.x = ui.canvas_bounds.width, .y = ui.canvas_bounds.height};
 
   // Initializing the audio struct and parsing if a filename was provided
@@ -187,35 +646,151 @@ int main(int argc, char **argv)
   memset(audio.fft_out, 0, sizeof(audio.fft_out));
   memset(audio.fft_smooth, 0, sizeof(audio.fft_smooth));
   memset(audio.amp_buffer, 0, sizeof(audio.amp_buffer));
+  memset(audio.ring, 0, sizeof(audio.ring));
+  scope_init(&audio.scope, BUFFER_SIZE, SCOPE_SEARCH, SCOPE_TRIGGER_EDGE);
+  normalizer_init(&audio.normalizer, NORM_LOW_PERCENTILE, NORM_HIGH_PERCENTILE, NORM_MIN_RANGE);
+  audio.norm_half_life = NORM_HALF_LIFE;
+  audio.zoom_low = 20.0f;
+  audio.zoom_high = 500.0f;
+  startup_join(startup.audio_thread, &startup.audio_started); // Nothing above needs the audio device
+  SetMasterVolume(0.5f);
 #if DEBUG_MODE
   load_audio("songs/lens.mp3");
 #endif
+  parse_args(argc, argv);
+  outputs_layout();
+  if (ui.run_self_check || ui.run_sound_check || bench.run || replay.replay_path != NULL)
+  {
+    bool passed = replay.replay_path != NULL ? replay_run() : bench.run ? shader_bench() : ui.run_self_check ? gpu_fft_self_check() : gpu_sound_self_check();
+    plugin_host_free(&plugins);
+    unload_shader_variants();
+    shader_source_free(&ui.shader_source);
+    shader_source_free(&startup.shader);
+    gpu_fft_unload(&audio.gpu);
+    gpu_sound_unload(&audio.sound);
+    CloseAudioDevice();
+    CloseWindow();
+    return passed ? 0 : 1;
+  }
 
   // Main loop
   while (!WindowShouldClose())
   {
-
+    scheduler_update();
     check_dropped_files();
+    plugin_host_poll(&plugins); // Reloads the changed ones
 
     if (IsKeyPressed(KEY_R))
     {
       reload_shader(ui.shader_filepath);
     }
 
+    if (IsKeyPressed(KEY_V))
+    {
+      use_shader_variant((ui.quality + 1) % QUALITY_COUNT);
+      fprintf(stderr, "Shader quality: %s\n", shader_quality_names[ui.quality]);
+    }
+
     if (IsKeyPressed(KEY_SPACE))
     {
       toggle_music_playing();
     }
 
+    if (IsKeyPressed(KEY_N) && audio.audio_loaded)
+    {
+      play_next_track();
+    }
+
+    if (IsKeyPressed(KEY_P) && audio.audio_loaded)
+    {
+      play_prev_track();
+    }
+
+    if (IsKeyPressed(KEY_S))
+    {
+      cancel_preload(); // The preloaded track might not be the next one anymore
+      playlist_shuffle(&ui.playlist);
+    }
+
+    if (IsKeyPressed(KEY_D))
+    {
+      audio.decode_mode = !audio.decode_mode;
+      fprintf(stderr, "Decoded playback: %s\n", audio.decode_mode ? "on" : "off");
+      if (audio.audio_loaded && ui.playlist.current >= 0) // Reload the current track in the new mode
+      {
+        f32 pos = track_time_played();
+        load_audio(playlist_get(&ui.playlist, ui.playlist.current));
+        track_seek(pos);
+      }
+    }
+
+    if (IsKeyPressed(KEY_C))
+    {
+      toggle_capture(CAPTURE_DEVICE, NULL);
+    }
+
+    if (IsKeyPressed(KEY_G))
+    {
+      toggle_gpu_fft();
+    }
+
+    if (IsKeyPressed(KEY_Q))
+    {
+      toggle_cqt();
+    }
+
+    if (IsKeyPressed(KEY_O))
+    {
+      audio.scope.mode = (audio.scope.mode + 1) % SCOPE_TRIGGER_COUNT;
+      audio.window_stale = true;
+      fprintf(stderr, "Waveform trigger: %s\n", scope_trigger_names[audio.scope.mode]);
+    }
+
+    if (IsKeyPressed(KEY_B))
+    {
+      scheduler.benchmark = !scheduler.benchmark;
+      fprintf(stderr, "Benchmark mode: %s\n", scheduler.benchmark ? "on" : "off");
+    }
+
+    if (IsKeyPressed(KEY_TAB) && visuals.shaders.count > 1)
+    {
+      visuals.requested = true;
+    }
+
+    if (IsKeyPressed(KEY_I))
+    {
+      ui.show_stats = !ui.show_stats;
+    }
+
+    if (IsKeyPressed(KEY_LEFT_BRACKET) || IsKeyPressed(KEY_RIGHT_BRACKET))
+    {
+      audio.latency_offset += IsKeyPressed(KEY_LEFT_BRACKET) ? -LATENCY_STEP : LATENCY_STEP;
+      fprintf(stderr, "Latency offset: %+.0f ms\n", audio.latency_offset * 1000.0f);
+    }
+
+    if (IsKeyPressed(KEY_E))
+    {
+      if (playlist_save_m3u(&ui.playlist, "playlist.m3u"))
+        fprintf(stderr, "Saved %u tracks to playlist.m3u\n", ui.playlist.count);
+    }
+
     Vector2 m_pos = GetMousePosition();
     if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) // Sliding the music stream (Not using the sliders value because it's messier that way)
     {
-      if (CheckCollisionPointRec(m_pos, ui.progress_bounds))
+      if (audio.audio_loaded && CheckCollisionPointRec(m_pos, ui.progress_bounds))
       {
-        f32 pos_in_secs = Remap(m_pos.x - ui.progress_bounds.x, 0.0f, ui.progress_bounds.width, 0.0f, GetMusicTimeLength(audio.music));
-        SeekMusicStream(audio.music, pos_in_secs);
+        f32 pos_in_secs = Remap(m_pos.x - ui.progress_bounds.x, 0.0f, ui.progress_bounds.width, 0.0f, track_time_length());
+        if (pos_in_secs != ui.seek_secs)
+        {
+          track_seek(pos_in_secs);
+          ui.seek_secs = pos_in_secs;
+        }
       }
     }
+    else
+    {
+      ui.seek_secs = -1.0f;
+    }
 
     if (IsWindowResized())
     {
@@ -234,42 +809,58 @@ int main(int argc, char **argv)
         ui.volume_hovered = false;
       }
 
-      UpdateMusicStream(audio.music);
-      audio.current_frame = (i32)(GetMusicTimePlayed(audio.music) * audio.music.stream.sampleRate);
+      track_update();
+      audio.current_frame = (i32)(track_time_played() * audio.music.stream.sampleRate);
+      preload_next_track();
 
       // queueing music
-      if (audio.current_frame == 0 && audio.audio_flag >= 2)
+      if (!IsMusicStreamPlaying(audio.music) && !audio.paused) // raylib stops the stream when it's over
       {
-
-        if (!queue_is_empty(&ui.music_queue))
+        if (playlist_has_next(&ui.playlist))
         {
-          char *data = dequeue(&ui.music_queue);
-          load_audio(data);
-          free(data);
+          play_next_track();
         }
         else // if there is no music on queue replay music
         {
-          PlayMusicStream(audio.music);
+          track_replay();
         }
       }
-      else if (audio.current_frame == 0 && audio.audio_flag < 2)
+    }
+
+    sound_update();
+    if (audio.audio_loaded || audio.capture.active || audio.sound.ready)
+    {
+      if (stream_rate() != ui.shader_rate) // The variants have SAMPLE_RATE compiled in (and the welcome screen needs none)
       {
-        audio.audio_flag++;
+        reload_shader(ui.shader_filepath);
       }
+      // A quad with raylib's 1x1 default texture, the shaders only need the texture coordinates (flipped)
+      Texture2D blank = {.id = rlGetTextureIdDefault(), .width = 1, .height = 1, .mipmaps = 1, .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+      visuals_update(blank);
+      outputs_update();
 
-      fft_prepare();
-      fft(audio.fft_in_windowed, audio.fft_out, 1, NFFT);
-      fft_postprocess();
+      if (replay.recording)
+      {
+        record_frame();
+      }
+      bool analysed = analysis_frame();
 
       BeginDrawing();
       ClearBackground(GetColor(GuiGetStyle(DEFAULT, BACKGROUND_COLOR)));
       BeginShaderMode(ui.shader);
       send_shader_uniforms(); // We send them here outherwise the sampler2D would be reset
-      // We flip the coordinates
-      DrawTextureRec(ui.canvas, (Rectangle){.x = 0.f, .y = 0.f, .width = ui.canvas_bounds.width, .height = -ui.canvas_bounds.height}, (Vector2){.x = ui.canvas_bounds.x, .y = ui.canvas_bounds.y}, BLACK);
+      if (outputs.count > 0)
+        outputs_draw(blank); // All of them from this analysis and upload
+      else
+        DrawTexturePro(blank, (Rectangle){.x = 0.f, .y = 0.f, .width = 1.f, .height = -1.f}, ui.canvas_bounds, (Vector2){0}, 0.0f, BLACK);
       EndShaderMode();
+      visuals_draw(blank); // The incoming shader on top while crossfading
       ui_draw();
+      stats_draw();
       EndDrawing();
+      measure_capture_latency();
+      if (analysed)
+        publish_update(); // After send_shader_uniforms(), so the song time is this frame's
     }
     else
     {
@@ -286,32 +877,67 @@ int main(int argc, char **argv)
       EndDrawing();
       GuiSetStyle(DEFAULT, TEXT_LINE_SPACING, default_line_spacing);
     }
-  }
 
-  if (IsMusicReady(audio.music))
-  {
-    DetachAudioStreamProcessor(audio.music.stream, audio_callback);
-    UnloadMusicStream(audio.music);
+    if (startup.first_frame_ms == 0.0f)
+    {
+      startup_first_frame();
+      if (startup.check)
+        break;
+    }
   }
+
+  capture_stop(&audio.capture);
+  plugin_host_free(&plugins);
+  analysis_shm_close(&audio.publish);
+  stop_sound_shader();
+  gpu_fft_unload(&audio.gpu);
+  cancel_preload();
+  tracker_switch(NULL, 0);
+  unload_track();
   UnloadFont(font);
-  UnloadTexture(ui.canvas);
+  UnloadRenderTexture(ui.bar);
   UnloadTexture(shader_uniforms.u_buffer);
-  UnloadShader(ui.shader);
-  queue_destroy(&ui.music_queue);
+  UnloadTexture(shader_uniforms.u_analysis);
+  UnloadTexture(shader_uniforms.u_plugins);
+  scope_free(&audio.scope);
+  chroma_map_free(&audio.chroma_map);
+  yin_free(&audio.yin);
+  cqt_free(&audio.cqt);
+  czt_free(&audio.czt);
+  decimator_free(&audio.decimator);
+  unload_shader_variants();
+  shader_source_free(&ui.shader_source);
+  shader_source_free(&startup.shader);
+  visuals_free();
+  outputs_free();
+  frame_block_unload(&shader_uniforms.frame_block);
+  playlist_destroy(&ui.playlist);
   CloseAudioDevice();
+  record_stop(); // The audio thread is gone
   CloseWindow();
-  return 0;
+  return startup.check && startup.first_frame_ms > startup.target_ms ? 1 : 0;
 }
 
 void reload_shader(const char *file_path)
 {
   fprintf(stderr, "Trying to (re)load shader: %s\n", GetFileName(file_path));
-  UnloadShader(ui.shader);
-  strcpy(ui.shader_filepath, file_path);
-  ui.shader = LoadShader(0, file_path);
-  shader_uniforms.u_buffer_loc = GetShaderLocation(ui.shader, "uBuffer");
-  shader_uniforms.u_resolution_loc = GetShaderLocation(ui.shader, "uResolution");
-  shader_uniforms.u_time_loc = GetShaderLocation(ui.shader, "uTime");
+  unload_shader_variants();
+  if (file_path != ui.shader_filepath)
+    strcpy(ui.shader_filepath, file_path);
+  shader_source_free(&ui.shader_source);
+  if (startup.shader.body != NULL && strcmp(startup.shader.path, ui.shader_filepath) == 0)
+  {
+    ui.shader_source = startup.shader; // Already read by the startup workers
+    memset(&startup.shader, 0, sizeof(startup.shader));
+  }
+  else
+  {
+    shader_source_free(&startup.shader); // A different shader was picked, it's of no use anymore
+    shader_source_load(&ui.shader_source, ui.shader_filepath);
+  }
+  ui.shader_rate = stream_rate();
+  use_shader_variant(ui.quality); // The other tiers are compiled when they're switched to
+  replay.shader[0] = '\0'; // Logged again with the next frame, even if it's the same file
   // { // Flashing the screen
   //   BeginDrawing();
   //   DrawRectangleLinesEx((Rectangle){0, 0, GetScreenWidth(), GetScreenHeight()}, 5.0f, GetColor(0x80FFDBFF));
@@ -320,6 +946,67 @@ void reload_shader(const char *file_path)
   // }
 }
 
+// Compiles shader_source for `quality` unless that variant already is, and draws with it from now on.
+// The tier and the host constants are injected as defines, so loops over them have fixed trip counts.
+void use_shader_variant(u32 quality)
+{
+  Shader *variant = &ui.shader_variants[quality];
+  if (variant->id == 0)
+  {
+    *variant = compile_shader_variant(&ui.shader_source, quality, ui.shader_rate);
+  }
+  ui.quality = quality;
+  ui.shader = *variant;
+  shader_uniforms.locs = shader_locs(ui.shader);
+}
+
+Shader compile_shader_variant(const ShaderSource *source, u32 quality, f32 rate)
+{
+  char prelude[1024];
+  snprintf(prelude, sizeof(prelude),
+           "#define BUFFER_SIZE %d\n#define NFFT %d\n#define SAMPLE_RATE %.1f\n#define ANALYSIS_RATE %.1f\n"
+           "#define QUALITY_LOW %d\n#define QUALITY_MEDIUM %d\n#define QUALITY_HIGH %d\n#define QUALITY %u\n"
+           "#define PLUGIN_MAX %d\n#define PLUGIN_VALUES %d\n%s",
+           BUFFER_SIZE, NFFT, rate, ANALYSIS_RATE, QUALITY_LOW, QUALITY_MEDIUM, QUALITY_HIGH, quality, PLUGIN_MAX, PLUGIN_VALUES, frame_block_glsl);
+  char *text = shader_source_assemble(source, prelude);
+  Shader shader = LoadShaderFromMemory(NULL, text); // Without a source that's raylib's default shader, like when it doesn't compile
+  free(text);
+  frame_block_bind_shader(shader);
+  return shader;
+}
+
+ShaderLocs shader_locs(Shader shader)
+{
+  /*
+    uniform vec2 uResolution;
+    uniform float uTime;
+    uniform float uSongTime;
+    uniform float uBuffer[BUFFER_SIZE];
+  */
+  ShaderLocs locs;
+  locs.u_buffer_loc = GetShaderLocation(shader, "uBuffer");
+  locs.u_analysis_loc = GetShaderLocation(shader, "uAnalysis");
+  locs.u_resolution_loc = GetShaderLocation(shader, "uResolution");
+  locs.u_time_loc = GetShaderLocation(shader, "uTime");
+  locs.u_song_time_loc = GetShaderLocation(shader, "uSongTime");
+  locs.u_pitch_loc = GetShaderLocation(shader, "uPitch");
+  locs.u_scope_offset_loc = GetShaderLocation(shader, "uScopeOffset");
+  locs.u_plugins_loc = GetShaderLocation(shader, "uPlugins");
+  locs.u_plugin_values_loc = GetShaderLocation(shader, "uPluginValues");
+  return locs;
+}
+
+void unload_shader_variants()
+{
+  for (u32 quality = 0; quality < QUALITY_COUNT; quality++)
+  {
+    if (ui.shader_variants[quality].id != 0)
+      UnloadShader(ui.shader_variants[quality]); // Leaves raylib's default shader alone
+    ui.shader_variants[quality] = (Shader){0};
+  }
+  ui.shader = (Shader){0};
+}
+
 void resize_window()
 {
   ui.window_size.x = (f32)GetRenderWidth();
@@ -329,27 +1016,24 @@ void resize_window()
   ui.stop_play_bounds = (Rectangle){.x = 0, .y = ui.window_size.y * 0.9, .width = 0.1 * ui.window_size.x, .height = ui.window_size.y * 0.1};
   ui.progress_bounds = (Rectangle){.x = 0.2 * ui.window_size.x, .y = ui.window_size.y * 0.9, .width = ui.window_size.x * 0.8, .height = ui.window_size.y * 0.1};
   ui.skip_bounds = (Rectangle){.x = 0.1 * ui.window_size.x, .y = ui.window_size.y * 0.9, .width = ui.window_size.x * 0.1, .height = ui.window_size.y * 0.1};
-  UnloadTexture(ui.canvas);
-  Image tmp = GenImageColor(ui.canvas_bounds.width, ui.canvas_bounds.height, BLANK);
-  ui.canvas = LoadTextureFromImage(tmp);
-  UnloadImage(tmp);
+  ui_bar_reserve(ui.window_size.x, ui.window_size.y - ui.music_name_bounds.y); // Only allocates when it outgrows the texture
   shader_uniforms.u_resolution = (Vector2){.x = ui.canvas_bounds.width, .y = ui.canvas_bounds.height};
+  outputs_layout();
 }
 
 // Wrapper around LoadMusicStream()
 void load_audio(const char *file_path)
 {
+  cancel_preload();
+  stop_sound_shader();
   audio.audio_loaded = false;
   strcpy(ui.music_name, GetFileNameWithoutExt(file_path));
-  if (IsMusicReady(audio.music))
+  tracker_switch(NULL, 0);
+  unload_track();
+  if (audio.decode_mode && decode_track(file_path, &audio.decoded_pcm[0]))
   {
-    DetachAudioStreamProcessor(audio.music.stream, audio_callback);
-    UnloadMusicStream(audio.music);
-    memset(audio.pixel_buffer, 0, sizeof(audio.pixel_buffer));
-    memset(audio.fft_in, 0, sizeof(audio.fft_in));
-    memset(audio.fft_out, 0, sizeof(audio.fft_out));
-    memset(audio.fft_smooth, 0, sizeof(audio.fft_smooth));
-    memset(audio.amp_buffer, 0, sizeof(audio.amp_buffer));
+    play_decoded();
+    return;
   }
   audio.music = LoadMusicStream(file_path);
   audio.music.looping = false;
@@ -364,205 +1048,2627 @@ void load_audio(const char *file_path)
   // }
   // }
   audio.audio_loaded = true;
-  audio.audio_flag = 0;
+  audio.paused = false;
   audio.current_frame = 0;
   AttachAudioStreamProcessor(audio.music.stream, audio_callback);
+  tracker_switch(file_path, audio.music.stream.sampleRate); // Before playing, it has to see every frame
   PlayMusicStream(audio.music);
 }
 
-void send_shader_uniforms()
+// Decodes the whole file with LoadWave() into float PCM, returns false if it couldn't be decoded (e.g. modules).
+// The samples are converted straight into the PcmBuffer (like WaveFormat() does), so only the decoded wave and
+// the buffer exist at the same time, not another float copy of the track on the heap.
+bool decode_track(const char *file_path, PcmBuffer *pcm)
 {
-  shader_uniforms.u_time = (f32)GetTime(); // Maybe should be done somewhere else
-  SetShaderValue(ui.shader, shader_uniforms.u_time_loc, &(shader_uniforms.u_time), SHADER_UNIFORM_FLOAT);
-  SetShaderValue(ui.shader, shader_uniforms.u_resolution_loc, &(shader_uniforms.u_resolution), SHADER_UNIFORM_VEC2);
-  SetShaderValueTexture(ui.shader, shader_uniforms.u_buffer_loc, shader_uniforms.u_buffer); // Maybe we can set it in send_shader_uniforms()
+  Wave wave = LoadWave(file_path);
+  if (!IsWaveReady(wave) || (wave.sampleSize != 8 && wave.sampleSize != 16 && wave.sampleSize != 32))
+  {
+    fprintf(stderr, "Couldn't decode [%s], falling back to streaming!\n", GetFileName(file_path));
+    UnloadWave(wave);
+    return false;
+  }
+  bool ok = pcm_buffer_alloc(pcm, wave.frameCount, wave.channels, wave.sampleRate);
+  if (ok)
+  {
+    size_t count = (size_t)wave.frameCount * wave.channels;
+    if (wave.sampleSize == 8) // Unsigned
+      for (size_t i = 0; i < count; i++)
+        pcm->data[i] = (f32)(((unsigned char *)wave.data)[i] - 128) / 128.0f;
+    else if (wave.sampleSize == 16)
+      for (size_t i = 0; i < count; i++)
+        pcm->data[i] = (f32)((short *)wave.data)[i] / 32768.0f;
+    else
+      memcpy(pcm->data, wave.data, pcm->bytes);
+  }
+  UnloadWave(wave);
+  return ok;
 }
 
-void ui_draw()
+// Starts playing decoded_pcm[0] through a callback driven stream.
+// audio.music only holds the stream then, so only the AudioStream part of the Music functions may be used on it.
+void play_decoded()
 {
-  GuiLabel(ui.music_name_bounds, ui.music_name);
-  const char *bt_text = TextFormat("#%d#", IsMusicStreamPlaying(audio.music) ? ICON_PLAYER_PAUSE : ICON_PLAYER_PLAY);
-  if (GuiButton(ui.stop_play_bounds, bt_text))
+  PcmBuffer *pcm = &audio.decoded_pcm[0];
+  audio.decoded = true;
+  audio.decoded_cur = 0;
+  audio.decoded_cursor = 0;
+  audio.decoded_seek_frame = 0;
+  audio.decoded_seek_track = 0;
+  audio.decoded_seek_seq = audio.decoded_seek_done = 0;
+  audio.decoded_next_ready = false;
+  audio.decoded_switched = false;
+  audio.decoded_finished = false;
+  audio.music = (Music){.stream = LoadAudioStream(pcm->sample_rate, 32, pcm->channels), .frameCount = (u32)pcm->frames, .looping = false};
+  SetAudioStreamCallback(audio.music.stream, decoded_stream_callback);
+  audio.audio_loaded = true;
+  audio.paused = false;
+  audio.current_frame = 0;
+  AttachAudioStreamProcessor(audio.music.stream, audio_callback);
+  PlayAudioStream(audio.music.stream);
+}
+
+// Runs on the audio thread, copies the decoded samples and continues with the preloaded track without a gap
+void decoded_stream_callback(void *bufferData, u32 frames)
+{
+  f32 *out = (f32 *)bufferData;
+  if (audio.decoded_seek_seq != audio.decoded_seek_done) // Seeking is just moving the cursor
   {
-    toggle_music_playing();
+    if (audio.decoded_seek_track == audio.decoded_cur) // Otherwise this switched tracks before it saw the seek
+      audio.decoded_cursor = audio.decoded_seek_frame;
+    audio.decoded_seek_done = audio.decoded_seek_seq;
   }
-  if (GuiButton(ui.skip_bounds, GuiIconText(ICON_PLAYER_NEXT, "")))
+  while (frames > 0)
   {
-    if (!queue_is_empty(&ui.music_queue))
+    PcmBuffer *pcm = &audio.decoded_pcm[audio.decoded_cur];
+    size_t cursor = audio.decoded_cursor;
+    size_t n = cursor < pcm->frames ? pcm->frames - cursor : 0;
+    if (n > frames)
+      n = frames;
+    memcpy(out, pcm->data + cursor * pcm->channels, n * pcm->channels * sizeof(f32));
+    out += n * pcm->channels;
+    frames -= n;
+    audio.decoded_cursor = cursor + n;
+    if (frames == 0)
+      break;
+    if (audio.decoded_next_ready) // Sample accurate switch, the rest of this buffer already comes from the next track
     {
-
-      char *data = dequeue(&ui.music_queue);
-      load_audio(data);
-      free(data);
+      audio.decoded_next_ready = false;
+      audio.decoded_cur ^= 1;
+      audio.decoded_cursor = 0;
+      audio.decoded_switched = true;
     }
     else
     {
-      fprintf(stderr, "Couldn't skip song, because the queue is empty!\n");
+      memset(out, 0, frames * pcm->channels * sizeof(f32));
+      audio.decoded_finished = true;
+      break;
     }
   }
-  f32 progress = GetMusicTimePlayed(audio.music);
-  GuiSlider(ui.progress_bounds, NULL, NULL, &progress, 0.0f, GetMusicTimeLength(audio.music));
-  if (!ui.volume_hovered)
+}
+
+static void audio_sync_noop(void *bufferData, u32 frames)
+{
+  (void)bufferData;
+  (void)frames;
+}
+
+// Returns once the audio thread is done with the current mixing pass (attaching a processor takes the mixer's lock)
+void audio_sync()
+{
+  AttachAudioStreamProcessor(audio.music.stream, audio_sync_noop);
+  DetachAudioStreamProcessor(audio.music.stream, audio_sync_noop);
+}
+
+void unload_track()
+{
+  if (audio.decoded)
   {
-    GuiButton(ui.volume_hover_bounds, GuiIconText(ICON_AUDIO, ""));
+    DetachAudioStreamProcessor(audio.music.stream, audio_callback);
+    UnloadAudioStream(audio.music.stream); // The callback isn't called anymore after this, so the PCM can go
+    pcm_buffer_free(&audio.decoded_pcm[0]);
+    pcm_buffer_free(&audio.decoded_pcm[1]);
+    audio.decoded = false;
   }
-  else
+  else if (IsMusicReady(audio.music))
   {
-    f32 vol = GetMasterVolume();
-    GuiSlider(ui.volume_slider_bounds, NULL, NULL, &vol, 0.0f, 1.0f);
-    SetMasterVolume(vol);
+    DetachAudioStreamProcessor(audio.music.stream, audio_callback);
+    UnloadMusicStream(audio.music);
   }
+  audio.music = (Music){0};
+}
 
-#if DEBUG_MODE
-  DrawRectangleLinesEx(ui.canvas_bounds, 1.0f, YELLOW);
-  DrawRectangleLinesEx(ui.music_name_bounds, 1.0f, YELLOW);
-  DrawRectangleLinesEx(ui.stop_play_bounds, 1.0f, YELLOW);
-  DrawRectangleLinesEx(ui.progress_bounds, 1.0f, YELLOW);
-  DrawRectangleLinesEx(ui.skip_bounds, 1.0f, YELLOW);
-  DrawRectangleLinesEx(ui.volume_hover_bounds, 1.0f, YELLOW);
-#endif
+// The audio thread continued with the preloaded track, catch up with it
+void decoded_catch_up()
+{
+  if (!audio.decoded_switched)
+    return;
+  audio.decoded_switched = false;
+  pcm_buffer_free(&audio.decoded_pcm[audio.decoded_cur ^ 1]);
+  audio.music.frameCount = (u32)audio.decoded_pcm[audio.decoded_cur].frames;
+  audio.preload_state = PRELOAD_IDLE;
+  audio.current_frame = 0;
+  playlist_next(&ui.playlist);
+  strcpy(ui.music_name, GetFileNameWithoutExt(audio.next_path));
 }
 
-void toggle_music_playing()
+// Called every frame instead of UpdateMusicStream()
+void track_update()
 {
-  if (IsMusicStreamPlaying(audio.music))
-    PauseMusicStream(audio.music);
-  else
-    ResumeMusicStream(audio.music);
+  if (!audio.decoded)
+  {
+    UpdateMusicStream(audio.music);
+    return;
+  }
+  decoded_catch_up();
+  if (audio.decoded_finished && IsAudioStreamPlaying(audio.music.stream))
+  {
+    StopAudioStream(audio.music.stream); // Same as raylib does with music streams
+  }
 }
 
-// Checks if files are dropped and loads the first one if there is no music playing.
-void check_dropped_files()
+// Plays the current track again from the start after it stopped
+void track_replay()
 {
-  static const char *supported_music_extensions[] = {".mp3", ".ogg", ".wav", ".qoa", ".xm", ".mod"};
-  static const char *supported_fragment_shader_extensions[] = {".frag", ".fs", ".glsl", ".fsdr", ".fsh", ".fragment"};
-  static const i32 se_cnt = 6;
-  if (IsFileDropped())
+  if (audio.decoded)
   {
-    FilePathList fp = LoadDroppedFiles();
-    for (i32 i = 0; i < fp.count; i++)
-    {
-      const char *ext = GetFileExtension(fp.paths[i]);
-      bool valid_extension = false;
-      for (i32 j = 0; j < se_cnt; j++)
-      {
-        if (strcmp(ext, supported_music_extensions[j]) == 0)
-        {
-          enqueue(&ui.music_queue, fp.paths[i]);
-          fprintf(stderr, "Queued: %s\n", GetFileName(fp.paths[i]));
-          valid_extension = true;
-          break;
-        }
-        else if (strcmp(ext, supported_fragment_shader_extensions[j]) == 0)
-        {
-          reload_shader(fp.paths[i]);
-          valid_extension = true;
-          break;
-        }
-      }
-      if (!valid_extension)
-      {
-        fprintf(stderr, "Unsupported file extension [%s] for fragment shaders or audio files!\n", ext);
-        fprintf(stderr, "Supported file extensions for fragment shaders:\n");
-        for (i32 j = 0; j < se_cnt; j++)
-        {
-          fprintf(stderr, "%s\t", supported_fragment_shader_extensions[j]);
-        }
-        fprintf(stderr, "\nSupported file extensions for audio files:\n");
-        for (i32 j = 0; j < se_cnt; j++)
-        {
-          fprintf(stderr, "%s\t", supported_music_extensions[j]);
-        }
-        fprintf(stderr, "\n");
-      }
-    }
-    if (!IsMusicReady(audio.music) && !queue_is_empty(&ui.music_queue))
+    track_seek(0.0f);
+    audio.decoded_finished = false;
+    PlayAudioStream(audio.music.stream);
+  }
+  else
+  {
+    if (audio.tracker != NULL)
     {
-      char *data = dequeue(&ui.music_queue);
-      load_audio(data);
-      free(data);
+      audio.tracker->reset_requested = 1;
     }
-    UnloadDroppedFiles(fp);
+    PlayMusicStream(audio.music);
   }
 }
 
-#define FACTOR (2 * (NFFT / BUFFER_SIZE))
-
-// Calculates the magnitude of the fft, normalizes it, and fills it into u_buffer
-void fft_postprocess()
+f32 track_time_played()
 {
+  if (audio.decoded)
+    return (f32)audio.decoded_cursor / (f32)audio.music.stream.sampleRate;
+  return GetMusicTimePlayed(audio.music);
+}
 
-  f32 min_value = audio.fft_smooth[0];
-  f32 max_value = audio.fft_smooth[0];
+f32 track_time_length()
+{
+  if (audio.decoded)
+    return (f32)audio.music.frameCount / (f32)audio.music.stream.sampleRate;
+  return GetMusicTimeLength(audio.music);
+}
 
-  f32 smoothing_factor = GetFrameTime() * (f32)FACTOR;
-  for (u32 i = 0; i < BUFFER_SIZE; ++i) // Only interested in the lower frequency bins
+void track_seek(f32 secs)
+{
+  if (replay.recording)
   {
-    f32 tmp = c2dB(audio.fft_out[i]);
-    tmp = isinf(tmp) ? 0.0 : tmp;                                                                   // safety check
-    audio.fft_smooth[i] = tmp * smoothing_factor + (1.0f - smoothing_factor) * audio.fft_smooth[i]; // (tmp - audio.fft_smooth[i]) *smoothing_factor;
-    min_value = fminf(min_value, audio.fft_smooth[i]);
-    max_value = fmaxf(max_value, audio.fft_smooth[i]);
+    replay_write(&replay.log, REPLAY_SEEK, clock_time(), &secs, sizeof(secs));
   }
-
-  // Update pixel buffer with the remapped values
-  for (u32 i = 0; i < BUFFER_SIZE; ++i)
+  if (!audio.decoded)
   {
-    // Remap using the smoothed values
-    unsigned char fft_val = (unsigned char)Remap(audio.fft_smooth[i], min_value, max_value, 0.0, 255.0);
-    unsigned char amp_val = (unsigned char)Remap(audio.amp_buffer[i], -1.0f, 1.0f, 0.0f, 255.0f);
-    // Update pixel buffer
-    audio.pixel_buffer[i] = (Color){.r = fft_val, .g = amp_val, .b = (unsigned char)0, .a = (unsigned char)0};
+    SeekMusicStream(audio.music, secs);
+    return;
+  }
+  decoded_catch_up(); // A seek right after a gapless switch is into the new track
+  i32 cur = audio.decoded_cur;
+  PcmBuffer *pcm = &audio.decoded_pcm[cur];
+  size_t frame = (size_t)Clamp(secs * pcm->sample_rate, 0.0f, (f32)pcm->frames);
+  audio.decoded_seek_frame = frame;
+  audio.decoded_seek_track = cur; // The audio thread may still switch before it picks the seek up, then it's dropped
+  audio.decoded_seek_seq++;
+  audio.decoded_cursor = frame; // So the progress bar doesn't jump back until the audio thread picked it up
+  audio.decoded_finished = false;
+  ring_refill(pcm, frame); // So the visuals don't show the old position
+}
+
+void *preload_thread_func(void *arg)
+{
+  (void)arg;
+  // Opening the decoder is the slow part (file io + headers), in decoded mode the whole track is decoded here
+  if (!audio.decoded || !decode_track(audio.next_path, &audio.decoded_pcm[audio.decoded_cur ^ 1]))
+  {
+    audio.next_music = LoadMusicStream(audio.next_path);
+  }
+  audio.preload_state = PRELOAD_LOADED;
+  return NULL;
+}
+
+// Called every frame, opens the next queued track in the background when the current one is about to end
+void preload_next_track()
+{
+  if (audio.preload_state == PRELOAD_IDLE && playlist_has_next(&ui.playlist) &&
+      track_time_length() - track_time_played() < PRELOAD_SECONDS)
+  {
+    strncpy(audio.next_path, playlist_peek_next(&ui.playlist), MAX_STRING_LEN - 1);
+    audio.preload_state = PRELOAD_LOADING;
+    if (pthread_create(&audio.preload_thread, NULL, preload_thread_func, NULL) != 0)
+    {
+      fprintf(stderr, "Couldn't start preload thread, loading [%s] on the main thread!\n", GetFileName(audio.next_path));
+      preload_thread_func(NULL);
+      finish_preload();
+    }
+  }
+  else if (audio.preload_state == PRELOAD_LOADED)
+  {
+    pthread_join(audio.preload_thread, NULL);
+    finish_preload();
+  }
+}
+
+// Runs on the main thread once next_music is opened
+void finish_preload()
+{
+  PcmBuffer *next_pcm = audio.decoded ? &audio.decoded_pcm[audio.decoded_cur ^ 1] : NULL;
+  if (next_pcm != NULL && next_pcm->data != NULL)
+  {
+    PcmBuffer *pcm = &audio.decoded_pcm[audio.decoded_cur];
+    // The audio thread can only continue with it if the stream format stays the same
+    audio.decoded_next_ready = next_pcm->sample_rate == pcm->sample_rate && next_pcm->channels == pcm->channels;
+    audio.preload_state = PRELOAD_READY;
+    return;
+  }
+  if (!IsMusicReady(audio.next_music))
+  {
+    fprintf(stderr, "Couldn't preload [%s]!\n", GetFileName(audio.next_path));
+    audio.preload_state = PRELOAD_IDLE;
+    return;
+  }
+  audio.next_music.looping = false;
+  AttachAudioStreamProcessor(audio.next_music.stream, audio_callback); // Not called until the stream is played
+  UpdateMusicStream(audio.next_music);                                 // Decodes into both sub-buffers, nothing is consumed yet
+  audio.preload_state = PRELOAD_READY;
+}
+
+// Switches to the preloaded track (or loads the next one in the playlist if nothing was preloaded yet).
+// The analysis buffers are kept, so the visuals carry over into the next track.
+void play_next_track()
+{
+  if (audio.preload_state == PRELOAD_LOADING || audio.preload_state == PRELOAD_LOADED)
+  {
+    pthread_join(audio.preload_thread, NULL); // The preload might not be done yet, just wait for it
+    finish_preload();
+  }
+  if (audio.decoded)
+  {
+    audio.decoded_next_ready = false;
+    audio_sync();
+    if (audio.decoded_switched) // The audio thread already switched on its own in the meantime
+    {
+      track_update();
+      return;
+    }
+  }
+  if (audio.preload_state != PRELOAD_READY)
+  {
+    if (playlist_has_next(&ui.playlist))
+    {
+      load_audio(playlist_next(&ui.playlist));
+    }
+    return;
+  }
+  playlist_next(&ui.playlist);
+  strcpy(ui.music_name, GetFileNameWithoutExt(audio.next_path));
+  audio.preload_state = PRELOAD_IDLE;
+  if (audio.decoded && audio.decoded_pcm[audio.decoded_cur ^ 1].data != NULL)
+  {
+    PcmBuffer next = audio.decoded_pcm[audio.decoded_cur ^ 1];
+    audio.decoded_pcm[audio.decoded_cur ^ 1] = (PcmBuffer){0};
+    unload_track();
+    audio.decoded_pcm[0] = next;
+    play_decoded();
+    return;
+  }
+  tracker_switch(audio.next_path, audio.next_music.stream.sampleRate);
+  PlayMusicStream(audio.next_music); // Start the new stream first, its buffers are already filled
+  Music next = audio.next_music;
+  audio.next_music = (Music){0};
+  unload_track();
+  audio.music = next;
+  audio.paused = false;
+  audio.current_frame = 0;
+}
+
+void play_prev_track()
+{
+  if (playlist_has_prev(&ui.playlist))
+  {
+    load_audio(playlist_prev(&ui.playlist)); // load_audio() also drops the preloaded track
+  }
+  else
+  {
+    track_seek(0.0f);
+  }
+}
+
+// Throws away the preloaded track, e.g. when the user loads something else directly
+void cancel_preload()
+{
+  if (audio.preload_state == PRELOAD_LOADING || audio.preload_state == PRELOAD_LOADED)
+  {
+    pthread_join(audio.preload_thread, NULL);
+    if (IsMusicReady(audio.next_music))
+    {
+      UnloadMusicStream(audio.next_music);
+    }
+  }
+  else if (audio.preload_state == PRELOAD_READY && IsMusicReady(audio.next_music))
+  {
+    DetachAudioStreamProcessor(audio.next_music.stream, audio_callback);
+    UnloadMusicStream(audio.next_music);
+  }
+  if (audio.decoded)
+  {
+    audio.decoded_next_ready = false;
+    audio_sync();
+    track_update();
+    pcm_buffer_free(&audio.decoded_pcm[audio.decoded_cur ^ 1]);
+  }
+  audio.next_music = (Music){0};
+  audio.preload_state = PRELOAD_IDLE;
+}
+
+void send_shader_uniforms()
+{
+  shader_uniforms.u_time = (f32)clock_time(); // Maybe should be done somewhere else
+  shader_uniforms.u_song_time = audible_song_time();
+  upload_shader_uniforms(clock_frame_time());
+}
+
+// Position in the track that is audible right now, from the audio clock
+f32 audible_song_time()
+{
+  if (replay.replaying)
+    return replay.song_time;
+  f32 played = audio.sound.ready ? (f32)audio.sound.fifo_read / (f32)audio.sound.sample_rate : track_time_played();
+  return fmaxf(played - output_latency(), 0.0f);
+}
+
+// Sets the loose uniforms and uploads uFrame from shader_uniforms and the analysis
+void upload_shader_uniforms(f32 delta_time)
+{
+  set_shader_values(ui.shader, &shader_uniforms.locs, shader_uniforms.u_resolution);
+
+  FrameData *frame = &shader_uniforms.frame_block.data;
+  frame->time = shader_uniforms.u_time;
+  frame->song_time = shader_uniforms.u_song_time;
+  frame->delta_time = delta_time;
+  frame->latency = output_latency();
+  frame->resolution[0] = shader_uniforms.u_resolution.x;
+  frame->resolution[1] = shader_uniforms.u_resolution.y;
+  frame->pitch[0] = shader_uniforms.u_pitch.x;
+  frame->pitch[1] = shader_uniforms.u_pitch.y;
+  frame->scope_offset = shader_uniforms.u_scope_offset;
+  frame->sample_rate = stream_rate();
+  frame->level = audio.level;
+  frame->bass = audio.bass;
+  frame->beat = audio.beat;
+  frame->frame++;
+  frame_block_upload(&shader_uniforms.frame_block); // The loose uniforms above stay for the shaders that use them
+}
+
+// The loose uniforms of `shader`, which has to be the active one (the samplers go with the next draw)
+void set_shader_values(Shader shader, const ShaderLocs *locs, Vector2 resolution)
+{
+  SetShaderValue(shader, locs->u_time_loc, &(shader_uniforms.u_time), SHADER_UNIFORM_FLOAT);
+  SetShaderValue(shader, locs->u_song_time_loc, &(shader_uniforms.u_song_time), SHADER_UNIFORM_FLOAT);
+  SetShaderValue(shader, locs->u_pitch_loc, &(shader_uniforms.u_pitch), SHADER_UNIFORM_VEC2);
+  SetShaderValue(shader, locs->u_scope_offset_loc, &(shader_uniforms.u_scope_offset), SHADER_UNIFORM_FLOAT);
+  SetShaderValue(shader, locs->u_resolution_loc, &resolution, SHADER_UNIFORM_VEC2);
+  SetShaderValueTexture(shader, locs->u_buffer_loc, audio.gpu_fft ? audio.gpu.output.texture : shader_uniforms.u_buffer); // Maybe we can set it in send_shader_uniforms()
+  SetShaderValueTexture(shader, locs->u_analysis_loc, shader_uniforms.u_analysis);
+  SetShaderValueTexture(shader, locs->u_plugins_loc, shader_uniforms.u_plugins);
+  SetShaderValueV(shader, locs->u_plugin_values_loc, audio.plugin_values, SHADER_UNIFORM_FLOAT, PLUGIN_MAX * PLUGIN_VALUES);
+}
+
+// Makes sure the control bar texture holds at least width x height, it only grows
+void ui_bar_reserve(f32 width, f32 height)
+{
+  if (ui.bar.id != 0 && width <= ui.bar.texture.width && height <= ui.bar.texture.height)
+    return;
+  i32 w = ((i32)ceilf(fmaxf(width, (f32)ui.bar.texture.width)) + UI_BAR_GRANULE - 1) / UI_BAR_GRANULE * UI_BAR_GRANULE;
+  i32 h = ((i32)ceilf(fmaxf(height, (f32)ui.bar.texture.height)) + UI_BAR_GRANULE - 1) / UI_BAR_GRANULE * UI_BAR_GRANULE;
+  UnloadRenderTexture(ui.bar);
+  ui.bar = LoadRenderTexture(w, h);
+  memset(&ui.bar_state, 0, sizeof(ui.bar_state)); // The new texture is empty, it has to be drawn
+}
+
+// The controls are drawn into ui.bar only when something they show or the mouse interaction with them
+// changed, every other frame just draws the texture. The volume control sits on the canvas and stays immediate.
+void ui_draw()
+{
+  Rectangle bar = {.x = 0.0f, .y = ui.music_name_bounds.y, .width = ui.window_size.x, .height = ui.window_size.y - ui.music_name_bounds.y};
+  UiBarState state;
+  memset(&state, 0, sizeof(state)); // memcmp() sees the padding
+  state.window_size = ui.window_size;
+  state.buttons = IsMouseButtonDown(MOUSE_BUTTON_LEFT) | IsMouseButtonPressed(MOUSE_BUTTON_LEFT) << 1 | IsMouseButtonReleased(MOUSE_BUTTON_LEFT) << 2;
+  Vector2 m_pos = GetMousePosition();
+  state.mouse = state.buttons != 0 || CheckCollisionPointRec(m_pos, bar) ? m_pos : (Vector2){-1.0f, -1.0f};
+  state.loaded = audio.audio_loaded;
+  if (audio.audio_loaded)
+  {
+    f32 length = track_time_length();
+    state.playing = IsMusicStreamPlaying(audio.music);
+    state.progress = length > 0.0f ? (i32)(track_time_played() / length * ui.progress_bounds.width) : 0;
+    snprintf(state.label, sizeof(state.label), "%s", ui.music_name);
+  }
+  else
+  {
+    snprintf(state.label, sizeof(state.label), "%s", audio.capture.active ? audio.capture.name : audio.sound.name);
+  }
+  if (memcmp(&state, &ui.bar_state, sizeof(state)) != 0)
+  {
+    ui.bar_state = state;
+    ui.bar_redraws++;
+    BeginTextureMode(ui.bar);
+    ClearBackground(GetColor(GuiGetStyle(DEFAULT, BACKGROUND_COLOR)));
+    rlPushMatrix();
+    rlTranslatef(0.0f, -bar.y, 0.0f); // The controls keep their window coordinates, raygui checks the mouse against them
+    ui_bar_controls();
+    rlPopMatrix();
+    EndTextureMode();
+  }
+  // Render textures are upside down, the bar is the top left corner of the texture
+  DrawTextureRec(ui.bar.texture, (Rectangle){.x = 0.0f, .y = ui.bar.texture.height - bar.height, .width = bar.width, .height = -bar.height}, (Vector2){.x = bar.x, .y = bar.y}, WHITE);
+
+  if (!audio.audio_loaded)
+    return;
+  if (!ui.volume_hovered)
+  {
+    GuiButton(ui.volume_hover_bounds, GuiIconText(ICON_AUDIO, ""));
+  }
+  else
+  {
+    f32 vol = GetMasterVolume();
+    GuiSlider(ui.volume_slider_bounds, NULL, NULL, &vol, 0.0f, 1.0f);
+    SetMasterVolume(vol);
+  }
+
+#if DEBUG_MODE
+  DrawRectangleLinesEx(ui.canvas_bounds, 1.0f, YELLOW);
+  DrawRectangleLinesEx(ui.music_name_bounds, 1.0f, YELLOW);
+  DrawRectangleLinesEx(ui.stop_play_bounds, 1.0f, YELLOW);
+  DrawRectangleLinesEx(ui.progress_bounds, 1.0f, YELLOW);
+  DrawRectangleLinesEx(ui.skip_bounds, 1.0f, YELLOW);
+  DrawRectangleLinesEx(ui.volume_hover_bounds, 1.0f, YELLOW);
+#endif
+}
+
+// Label, play/pause, skip and progress, drawn into ui.bar
+void ui_bar_controls()
+{
+  GuiLabel(ui.music_name_bounds, ui.bar_state.label);
+  if (!audio.audio_loaded) // Only live input or a sound shader, there are no track controls
+    return;
+  const char *bt_text = TextFormat("#%d#", IsMusicStreamPlaying(audio.music) ? ICON_PLAYER_PAUSE : ICON_PLAYER_PLAY);
+  if (GuiButton(ui.stop_play_bounds, bt_text))
+  {
+    toggle_music_playing();
+  }
+  if (GuiButton(ui.skip_bounds, GuiIconText(ICON_PLAYER_NEXT, "")))
+  {
+    if (playlist_has_next(&ui.playlist))
+    {
+      play_next_track();
+    }
+    else
+    {
+      fprintf(stderr, "Couldn't skip song, because the queue is empty!\n");
+    }
+  }
+  f32 progress = track_time_played();
+  GuiSlider(ui.progress_bounds, NULL, NULL, &progress, 0.0f, track_time_length());
+}
+
+void toggle_music_playing()
+{
+  if (!audio.audio_loaded && audio.sound.ready)
+  {
+    audio.paused = IsAudioStreamPlaying(audio.sound_stream);
+    if (audio.paused)
+      PauseAudioStream(audio.sound_stream);
+    else
+      ResumeAudioStream(audio.sound_stream);
+    return;
+  }
+  audio.paused = IsMusicStreamPlaying(audio.music);
+  if (audio.paused)
+    PauseMusicStream(audio.music);
+  else
+    ResumeMusicStream(audio.music);
+}
+
+// Checks if files are dropped and loads the first one if there is no music playing.
+// Music files are added to the playlist in one bulk insert, so dropping thousands of files stays cheap.
+void check_dropped_files()
+{
+  static const char *supported_music_extensions[] = {".mp3", ".ogg", ".wav", ".qoa", ".xm", ".mod"};
+  static const char *supported_fragment_shader_extensions[] = {".frag", ".fs", ".glsl", ".fsdr", ".fsh", ".fragment"};
+  static const char *supported_playlist_extensions[] = {".m3u", ".m3u8"};
+  static const i32 se_cnt = 6;
+  static const i32 pe_cnt = 2;
+  if (IsFileDropped())
+  {
+    FilePathList fp = LoadDroppedFiles();
+    char **music_paths = (char **)malloc(fp.count * sizeof(char *)); // Points into fp, nothing is copied here
+    u32 music_cnt = 0;
+    u32 queued_cnt = 0;
+    i32 shader_idx = -1;
+    u32 unsupported_cnt = 0;
+    const char *unsupported_ext = NULL;
+    for (i32 i = 0; i < fp.count; i++)
+    {
+      const char *ext = GetFileExtension(fp.paths[i]);
+      bool valid_extension = false;
+      for (i32 j = 0; j < se_cnt && ext != NULL; j++)
+      {
+        if (strcmp(ext, supported_music_extensions[j]) == 0)
+        {
+          if (music_paths != NULL)
+            music_paths[music_cnt++] = fp.paths[i];
+          valid_extension = true;
+          break;
+        }
+        else if (strcmp(ext, supported_fragment_shader_extensions[j]) == 0)
+        {
+          shader_idx = i; // Only the last dropped shader gets compiled
+          valid_extension = true;
+          break;
+        }
+      }
+      for (i32 j = 0; j < pe_cnt && ext != NULL && !valid_extension; j++)
+      {
+        if (strcmp(ext, supported_playlist_extensions[j]) == 0)
+        {
+          if (music_paths != NULL) // Keep the drop order
+            queued_cnt += playlist_append_many(&ui.playlist, music_paths, music_cnt);
+          music_cnt = 0;
+          i32 added = playlist_load_m3u(&ui.playlist, fp.paths[i]);
+          if (added >= 0)
+            fprintf(stderr, "Loaded %d tracks from playlist: %s\n", added, GetFileName(fp.paths[i]));
+          valid_extension = true;
+        }
+      }
+      if (!valid_extension)
+      {
+        unsupported_cnt++;
+        unsupported_ext = ext;
+      }
+    }
+    if (music_cnt > 0)
+    {
+      queued_cnt += playlist_append_many(&ui.playlist, music_paths, music_cnt);
+    }
+    if (queued_cnt > 0)
+    {
+      fprintf(stderr, "Queued %u files (%u in playlist)\n", queued_cnt, ui.playlist.count);
+    }
+    free(music_paths);
+    if (shader_idx >= 0)
+    {
+      char *text = LoadFileText(fp.paths[shader_idx]);
+      bool sound = text != NULL && strstr(text, "mainSound") != NULL; // Shadertoy's sound entry point
+      UnloadFileText(text);
+      if (!sound)
+        reload_shader(fp.paths[shader_idx]);
+      else
+        start_sound_shader(fp.paths[shader_idx]);
+    }
+    if (unsupported_cnt > 0)
+    {
+      fprintf(stderr, "Unsupported file extension [%s] for fragment shaders or audio files! (%u files skipped)\n", unsupported_ext ? unsupported_ext : "", unsupported_cnt);
+      fprintf(stderr, "Supported file extensions for fragment shaders:\n");
+      for (i32 j = 0; j < se_cnt; j++)
+      {
+        fprintf(stderr, "%s\t", supported_fragment_shader_extensions[j]);
+      }
+      fprintf(stderr, "\nSupported file extensions for audio files:\n");
+      for (i32 j = 0; j < se_cnt; j++)
+      {
+        fprintf(stderr, "%s\t", supported_music_extensions[j]);
+      }
+      fprintf(stderr, "\nSupported file extensions for playlists:\n");
+      for (i32 j = 0; j < pe_cnt; j++)
+      {
+        fprintf(stderr, "%s\t", supported_playlist_extensions[j]);
+      }
+      fprintf(stderr, "\n");
+    }
+    if (!audio.audio_loaded && playlist_has_next(&ui.playlist))
+    {
+      load_audio(playlist_next(&ui.playlist));
+    }
+    UnloadDroppedFiles(fp);
+  }
+}
+
+// Calculates the magnitude of the fft, normalizes it, and fills it into u_buffer
+void fft_postprocess()
+{
+  // The spectrum is mapped with the range of the recent frames (up to the last one), so the values go into the
+  // histogram and out to the pixel buffer in the same pass. The range moves slowly, a frame of lag doesn't show.
+  Normalizer *norm = &audio.normalizer;
+  f32 scale = 255.0f / (norm->high - norm->low);
+  f32 smoothing_factor = clock_frame_time() * (f32)FACTOR;
+  for (u32 i = 0; i < BUFFER_SIZE; ++i) // Only interested in the lower frequency bins
+  {
+    f32 tmp = c2dB(audio.fft_out[i]);
+    tmp = isinf(tmp) ? 0.0 : tmp;                                                                   // safety check
+    audio.fft_smooth[i] = tmp * smoothing_factor + (1.0f - smoothing_factor) * audio.fft_smooth[i]; // (tmp - audio.fft_smooth[i]) *smoothing_factor;
+    normalizer_add(norm, audio.fft_smooth[i]);
+    unsigned char fft_val = (unsigned char)Clamp((audio.fft_smooth[i] - norm->low) * scale, 0.0f, 255.0f);
+    unsigned char amp_val = (unsigned char)Remap(audio.amp_buffer[i], -1.0f, 1.0f, 0.0f, 255.0f);
+    audio.pixel_buffer[i] = (Color){.r = fft_val, .g = amp_val, .b = (unsigned char)0, .a = (unsigned char)0};
+  }
+  normalizer_update(norm, exp2f(-clock_frame_time() / audio.norm_half_life));
+  // Update shader uniform with the smoothed values
+  UpdateTexture(shader_uniforms.u_buffer, audio.pixel_buffer);
+}
+
+void toggle_gpu_fft()
+{
+  if (!audio.gpu.ready && !gpu_fft_init(&audio.gpu, NFFT, BUFFER_SIZE)) // Created the first time it's used
+    return;
+  audio.gpu_fft = !audio.gpu_fft;
+  audio.window_stale = true;
+  fprintf(stderr, "Analysis: %s\n", audio.gpu_fft ? "GPU" : "CPU");
+}
+
+void toggle_cqt()
+{
+  audio.cqt_enabled = !audio.cqt_enabled;
+  audio.window_stale = true;
+  fprintf(stderr, "Constant-Q and zoom analysis: %s\n", audio.cqt_enabled ? "on" : "off");
+  if (!audio.cqt_enabled) // Don't leave the last frame in the texture
+  {
+    u32 rows[] = {ANALYSIS_ROW_CQT, ANALYSIS_ROW_ZOOM};
+    for (u32 i = 0; i < sizeof(rows) / sizeof(rows[0]); i++)
+    {
+      memset(audio.analysis[rows[i]], 0, sizeof(audio.analysis[0]));
+      memset(audio.analysis_smooth[rows[i]], 0, sizeof(audio.analysis_smooth[0]));
+    }
+    UpdateTexture(shader_uniforms.u_analysis, audio.analysis);
+  }
+}
+
+// Sample rate of the ring, the measured one snapped to a common rate so the filters aren't rebuilt all the time
+f32 stream_rate()
+{
+  if (audio.capture.active)
+    return (f32)audio.capture.sample_rate;
+  static const f32 rates[] = {22050.0f, 32000.0f, 44100.0f, 48000.0f, 88200.0f, 96000.0f, 176400.0f, 192000.0f};
+  f32 measured = audio.device_rate > 0.0f ? audio.device_rate : (f32)audio.music.stream.sampleRate;
+  f32 rate = rates[0];
+  for (u32 i = 1; i < sizeof(rates) / sizeof(rates[0]); i++)
+  {
+    if (fabsf(rates[i] - measured) < fabsf(rate - measured))
+      rate = rates[i];
+  }
+  return rate;
+}
+
+// Computes the uAnalysis rows from the current window
+void analysis_update()
+{
+  static f32 values[BUFFER_SIZE];
+  f32 rate = stream_rate();
+  if (audio.bank.sample_rate != rate) // Picked up by the audio thread with its next period, it filters the ring itself
+  {
+    filterbank_design(&audio.bank, FILTERBANK_BANDS, FILTERBANK_LOW, FILTERBANK_HIGH, rate);
+  }
+  const f32 *energies = filterbank_energies(&audio.bank);
+  for (u32 i = 0; i < FILTERBANK_BANDS; i++) // No smoothing, the envelope followers already do it and they are fast on purpose
+  {
+    f32 db = energies[i] > 0.0f ? f2dB(energies[i]) : FILTERBANK_FLOOR_DB;
+    audio.analysis[ANALYSIS_ROW_BANDS][i] = Clamp((db - FILTERBANK_FLOOR_DB) / -FILTERBANK_FLOOR_DB, 0.0f, 1.0f);
+  }
+
+  if (audio.cqt_enabled)
+  {
+    constant_q_update(ANALYSIS_RATE, values);
+  }
+  if (!audio.gpu_fft) // Needs fft_out, the GPU analysis doesn't read the spectrum back
+  {
+    harmonic_update(ANALYSIS_RATE);
+  }
+  else
+  {
+    memset(audio.analysis[ANALYSIS_ROW_CHROMA], 0, sizeof(audio.analysis[0]));
+    shader_uniforms.u_pitch = (Vector2){0};
+  }
+  tracker_update();
+  features_update();
+  UpdateTexture(shader_uniforms.u_analysis, audio.analysis);
+}
+
+// Chroma row and uPitch from the spectrum fft() just computed
+void harmonic_update(f32 rate)
+{
+  static f32 chroma[CHROMA_CLASSES];
+  if (audio.chroma_map.sample_rate != rate)
+  {
+    chroma_map_free(&audio.chroma_map);
+    if (!chroma_map_init(&audio.chroma_map, NFFT, rate, CHROMA_LOW, CHROMA_HIGH))
+      return;
+  }
+  if (audio.yin.n == 0 && !yin_init(&audio.yin, NFFT))
+    return;
+
+  chroma_compute(&audio.chroma_map, audio.fft_out, chroma);
+  f32 smoothing_factor = clock_frame_time() * (f32)FACTOR;
+  f32 max_value = 0.0f;
+  for (u32 i = 0; i < CHROMA_CLASSES; i++)
+  {
+    audio.chroma_smooth[i] = chroma[i] * smoothing_factor + (1.0f - smoothing_factor) * audio.chroma_smooth[i];
+    max_value = fmaxf(max_value, audio.chroma_smooth[i]);
+  }
+  for (u32 i = 0; i < CHROMA_CLASSES; i++)
+  {
+    audio.analysis[ANALYSIS_ROW_CHROMA][i] = max_value > 0.0f ? audio.chroma_smooth[i] / max_value : 0.0f;
+  }
+
+  f32 confidence;
+  f32 f0 = yin_estimate(&audio.yin, audio.fft_out, audio.fft_in_windowed, rate, PITCH_LOW, PITCH_HIGH, &confidence);
+  shader_uniforms.u_pitch = (Vector2){.x = f0, .y = confidence};
+}
+
+// The constant-Q and zoom rows
+void constant_q_update(f32 rate, f32 *values)
+{
+  if (audio.cqt.sample_rate != rate) // First frame or another device
+  {
+    cqt_free(&audio.cqt);
+    if (!cqt_init(&audio.cqt, NFFT, CQT_BINS, CQT_MIN_FREQ, rate))
+    {
+      audio.cqt_enabled = false;
+      return;
+    }
+  }
+  if (audio.czt.sample_rate != rate || audio.czt.low != audio.zoom_low || audio.czt.high != audio.zoom_high)
+  {
+    czt_free(&audio.czt);
+    if (!czt_init(&audio.czt, NFFT, ZOOM_BINS, audio.zoom_low, audio.zoom_high, rate))
+    {
+      audio.cqt_enabled = false;
+      return;
+    }
+  }
+  cqt_run(&audio.cqt, audio.fft_in, values); // The kernels are windowed themselves
+  analysis_row_update(ANALYSIS_ROW_CQT, values, audio.cqt.bins);
+  czt_run(&audio.czt, audio.fft_in_windowed, values);
+  analysis_row_update(ANALYSIS_ROW_ZOOM, values, ZOOM_BINS);
+}
+
+// Level, bass and a beat pulse for uFrame. A beat is the bass energy jumping above its slow average.
+void features_update()
+{
+  f32 dt = clock_frame_time();
+  f32 sum = 0.0f;
+  for (u32 i = 0; i < BUFFER_SIZE; i++)
+  {
+    sum += audio.amp_buffer[i] * audio.amp_buffer[i];
+  }
+  audio.level = sqrtf(sum / BUFFER_SIZE);
+  f32 bass = 0.0f;
+  for (u32 i = 0; i < BEAT_BANDS; i++)
+  {
+    bass += audio.analysis[ANALYSIS_ROW_BANDS][i] / BEAT_BANDS;
+  }
+  audio.bass = bass;
+  audio.bass_avg += (1.0f - expf(-dt / 0.5f)) * (bass - audio.bass_avg);
+  double now = clock_time();
+  if (bass > BEAT_THRESHOLD * audio.bass_avg + 0.05f && now - audio.beat_time > BEAT_HOLD)
+  {
+    audio.beat = 1.0f;
+    audio.beat_time = now;
+  }
+  else
+  {
+    audio.beat *= expf(-dt / 0.1f);
+  }
+}
+
+// Copies this frame's analysis into the next slot of the shared memory ring, the readers are never waited for
+void publish_update()
+{
+  if (audio.publish.header == NULL)
+    return;
+  AnalysisShmFrame *frame = analysis_shm_begin(&audio.publish);
+  frame->sample_position = audio.window_end;
+  frame->sample_rate = stream_rate();
+  frame->song_time = shader_uniforms.u_song_time;
+  frame->level = audio.level;
+  frame->bass = audio.bass;
+  frame->beat = audio.beat;
+  frame->pitch[0] = shader_uniforms.u_pitch.x;
+  frame->pitch[1] = shader_uniforms.u_pitch.y;
+  frame->spectrum_valid = !audio.gpu_fft;
+  if (!audio.gpu_fft)
+    memcpy(frame->spectrum_db, audio.fft_smooth, sizeof(audio.fft_smooth));
+  memcpy(frame->waveform, audio.amp_buffer, sizeof(audio.amp_buffer));
+  memcpy(frame->rows, audio.analysis, sizeof(audio.analysis));
+  analysis_shm_publish(&audio.publish, frame);
+}
+
+// Replaces the shadow player of the previous module with one for `path` (NULL or not a module: none).
+// Called before the new stream is played, so the shadow player sees every frame of it.
+void tracker_switch(const char *path, u32 sample_rate)
+{
+  Tracker *old = audio.tracker;
+  audio.tracker = NULL;
+  if (old != NULL)
+  {
+    audio_sync(); // The audio thread might still be in tracker_process()
+    tracker_free(old);
+    free(old);
+  }
+  memset(audio.analysis[ANALYSIS_ROW_TRACKER], 0, sizeof(audio.analysis[0]));
+  memset(audio.tracker_seen, 0, sizeof(audio.tracker_seen));
+  memset(audio.tracker_flash, 0, sizeof(audio.tracker_flash));
+  if (path == NULL || !IsFileExtension(path, ".xm;.mod"))
+    return;
+  Tracker *tracker = (Tracker *)malloc(sizeof(Tracker));
+  if (tracker == NULL || !tracker_init(tracker, path, sample_rate))
+  {
+    free(tracker);
+    return;
+  }
+  fprintf(stderr, "Tracker: %u channels\n", tracker->channels);
+  audio.tracker = tracker;
+}
+
+// Tracker row from the snapshot at the audible position:
+// texels 0..31 are the channel levels, 32..63 the notes / 128 and 64..95 flash to 1 on every note-on
+void tracker_update()
+{
+  Tracker *tracker = audio.tracker;
+  if (tracker == NULL || audio.capture.active)
+    return;
+  const TrackerSnapshot *newest = tracker_snapshot_at(tracker, audio.window_end);
+  if (newest == NULL)
+    return;
+  TrackerSnapshot snapshot = *newest; // The audio thread keeps writing the history
+  f32 *row = audio.analysis[ANALYSIS_ROW_TRACKER];
+  f32 decay = expf(-clock_frame_time() / TRACKER_FLASH);
+  for (u32 c = 0; c < tracker->channels; c++)
+  {
+    audio.tracker_flash[c] = snapshot.triggers[c] != audio.tracker_seen[c] ? 1.0f : audio.tracker_flash[c] * decay;
+    audio.tracker_seen[c] = snapshot.triggers[c];
+    row[c] = snapshot.level[c];
+    row[TRACKER_MAX_CHANNELS + c] = snapshot.note[c] / 128.0f;
+    row[2 * TRACKER_MAX_CHANNELS + c] = audio.tracker_flash[c];
+  }
+}
+
+// Replaces the music with the sound shader at `path`, the stream starts once enough blocks are queued
+bool start_sound_shader(const char *path)
+{
+  char *source = LoadFileText(path);
+  if (source == NULL)
+    return false;
+  stop_sound_shader();
+  cancel_preload();
+  tracker_switch(NULL, 0);
+  unload_track();
+  audio.audio_loaded = false;
+  bool ok = gpu_sound_init(&audio.sound, source, GetFileName(path), SOUND_RATE);
+  UnloadFileText(source);
+  if (!ok)
+    return false;
+  audio.sound_stream = LoadAudioStream(SOUND_RATE, 32, 2);
+  SetAudioStreamCallback(audio.sound_stream, sound_stream_callback);
+  AttachAudioStreamProcessor(audio.sound_stream, audio_callback);
+  if (audio.device_rate == 0.0f)
+  {
+    audio.device_rate = (f32)SOUND_RATE; // Until it's measured
+  }
+  audio.paused = false;
+  fprintf(stderr, "Sound shader: %s (%d Hz, %d frame blocks, %d ahead)\n", audio.sound.name, SOUND_RATE, GPU_SOUND_BLOCK, GPU_SOUND_AHEAD);
+  return true;
+}
+
+void stop_sound_shader()
+{
+  if (!audio.sound.ready)
+    return;
+  if (IsAudioStreamReady(audio.sound_stream))
+  {
+    DetachAudioStreamProcessor(audio.sound_stream, audio_callback);
+    UnloadAudioStream(audio.sound_stream); // The callback isn't called anymore after this, so the FIFO can go
+  }
+  audio.sound_stream = (AudioStream){0};
+  gpu_sound_unload(&audio.sound);
+}
+
+// Runs on the audio thread
+void sound_stream_callback(void *bufferData, u32 frames)
+{
+  gpu_sound_read(&audio.sound, (f32 *)bufferData, frames);
+}
+
+// Called every frame: renders and collects blocks, starts the stream once it's primed
+void sound_update()
+{
+  if (!audio.sound.ready)
+    return;
+  gpu_sound_update(&audio.sound);
+  if (!IsAudioStreamPlaying(audio.sound_stream) && !audio.paused &&
+      gpu_sound_queued(&audio.sound) >= GPU_SOUND_AHEAD * GPU_SOUND_BLOCK / 2) // Playing earlier would count underruns
+  {
+    PlayAudioStream(audio.sound_stream);
+  }
+  if (GetTime() - audio.sound_stats_reset > STATS_WINDOW)
+  {
+    audio.sound_stats_reset = GetTime();
+    gpu_sound_reset_stats(&audio.sound);
+  }
+}
+
+// Same treatment as the uBuffer spectrum: dB, smoothed over time and stretched to 0..1
+void analysis_row_update(u32 row, const f32 *values, u32 count)
+{
+  f32 *smooth = audio.analysis_smooth[row];
+  f32 min_value = INFINITY;
+  f32 max_value = -INFINITY;
+  f32 smoothing_factor = clock_frame_time() * (f32)FACTOR;
+  for (u32 i = 0; i < count; i++)
+  {
+    f32 tmp = f2dB(values[i]);
+    tmp = isinf(tmp) ? 0.0f : tmp;
+    smooth[i] = tmp * smoothing_factor + (1.0f - smoothing_factor) * smooth[i];
+    min_value = fminf(min_value, smooth[i]);
+    max_value = fmaxf(max_value, smooth[i]);
+  }
+  for (u32 i = 0; i < count; i++)
+  {
+    audio.analysis[row][i] = max_value > min_value ? (smooth[i] - min_value) / (max_value - min_value) : 0.0f;
+  }
+}
+
+// Runs both backends on the same test signal (two tones and noise) and compares them
+bool gpu_fft_self_check()
+{
+  static f32 gpu_spectrum[2 * NFFT];
+  static f32 gpu_output[4 * BUFFER_SIZE];
+  if (!audio.gpu.ready && !gpu_fft_init(&audio.gpu, NFFT, BUFFER_SIZE))
+    return false;
+  u32 seed = 1;
+  for (i32 i = 0; i < NFFT; i++)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    f32 noise = (f32)(seed >> 8) / (f32)(1 << 24) - 0.5f;
+    audio.fft_in[i] = 0.5f * sinf(2.0f * PI * 440.0f * i / 48000.0f) + 0.25f * sinf(2.0f * PI * 3001.0f * i / 48000.0f) + 0.1f * noise;
+  }
+  memcpy(audio.amp_buffer, audio.fft_in + NFFT - BUFFER_SIZE, sizeof(audio.amp_buffer));
+  fft_prepare();
+  fft(audio.fft_in_windowed, audio.fft_out, 1, NFFT);
+  gpu_fft_run(&audio.gpu, audio.fft_in_windowed, audio.amp_buffer, 1.0f); // No smoothing, the output is just this spectrum
+  if (!gpu_fft_read_spectrum(&audio.gpu, gpu_spectrum) || !gpu_fft_read_output(&audio.gpu, gpu_output))
+  {
+    fprintf(stderr, "GPU FFT self-check: couldn't read the textures back\n");
+    return false;
+  }
+
+  f32 peak = 0.0f;
+  f32 spectrum_error = 0.0f;
+  for (i32 i = 0; i < NFFT; i++)
+  {
+    peak = fmaxf(peak, cabsf(audio.fft_out[i]));
+    spectrum_error = fmaxf(spectrum_error, cabsf(audio.fft_out[i] - (gpu_spectrum[2 * i] + gpu_spectrum[2 * i + 1] * I)));
+  }
+  spectrum_error /= peak;
+
+  // The CPU normalization of fft_postprocess() without smoothing and without the 8 bit quantization
+  f32 min_value = INFINITY;
+  f32 max_value = -INFINITY;
+  for (i32 i = 0; i < BUFFER_SIZE; i++)
+  {
+    f32 tmp = c2dB(audio.fft_out[i]);
+    audio.fft_smooth[i] = isinf(tmp) ? 0.0f : tmp;
+    min_value = fminf(min_value, audio.fft_smooth[i]);
+    max_value = fmaxf(max_value, audio.fft_smooth[i]);
+  }
+  f32 buffer_error = 0.0f;
+  for (i32 i = 0; i < BUFFER_SIZE; i++)
+  {
+    f32 fft_val = (audio.fft_smooth[i] - min_value) / (max_value - min_value);
+    f32 amp_val = audio.amp_buffer[i] * 0.5f + 0.5f;
+    buffer_error = fmaxf(buffer_error, fabsf(fft_val - gpu_output[4 * i]));
+    buffer_error = fmaxf(buffer_error, fabsf(amp_val - gpu_output[4 * i + 1]));
+  }
+  memset(audio.fft_smooth, 0, sizeof(audio.fft_smooth));
+
+  bool passed = spectrum_error < 1e-4f && buffer_error < 1e-3f;
+  fprintf(stderr, "GPU FFT self-check: spectrum error %.2e (of the peak), uBuffer error %.2e: %s\n",
+          spectrum_error, buffer_error, passed ? "PASSED" : "FAILED");
+  return passed;
+}
+
+// Deterministic uBuffer for benchmark frame `index`: the window ending index / BENCH_FPS seconds into `wave`
+// (mono at ANALYSIS_RATE, looped), or a synthetic kick, chord and noise. Unsmoothed, like the self-check.
+static void bench_input(u32 index, const f32 *wave, u32 wave_frames)
+{
+  long long end = (long long)((index + 1) * ANALYSIS_RATE / BENCH_FPS);
+  u32 seed = 1 + index;
+  for (i32 i = 0; i < NFFT; i++)
+  {
+    long long n = end + i - NFFT; // Sample number, negative for the first frames
+    if (wave != NULL)
+    {
+      audio.fft_in[i] = wave[((n % wave_frames) + wave_frames) % wave_frames];
+      continue;
+    }
+    f32 t = (f32)n / ANALYSIS_RATE;
+    f32 beat = fmodf(t, 0.5f); // A kick every half second
+    seed = seed * 1664525u + 1013904223u;
+    f32 noise = (f32)(seed >> 8) / (f32)(1 << 24) - 0.5f;
+    f32 chord = sinf(2.0f * PI * 220.0f * t) + sinf(2.0f * PI * 277.2f * t) + sinf(2.0f * PI * 329.6f * t);
+    audio.fft_in[i] = 0.6f * expf(-beat * 12.0f) * sinf(2.0f * PI * 55.0f * t) + 0.1f * (1.0f + sinf(t)) * chord + 0.05f * noise;
+  }
+  memcpy(audio.amp_buffer, audio.fft_in + NFFT - BUFFER_SIZE, sizeof(audio.amp_buffer));
+  fft_prepare();
+  fft(audio.fft_in_windowed, audio.fft_out, 1, NFFT);
+  f32 min_value = INFINITY, max_value = -INFINITY, sum = 0.0f;
+  for (i32 i = 0; i < BUFFER_SIZE; i++)
+  {
+    f32 tmp = c2dB(audio.fft_out[i]);
+    audio.fft_smooth[i] = isinf(tmp) ? 0.0f : tmp;
+    min_value = fminf(min_value, audio.fft_smooth[i]);
+    max_value = fmaxf(max_value, audio.fft_smooth[i]);
+    sum += audio.amp_buffer[i] * audio.amp_buffer[i];
+  }
+  for (i32 i = 0; i < BUFFER_SIZE; i++)
+  {
+    unsigned char fft_val = (unsigned char)Remap(audio.fft_smooth[i], min_value, max_value, 0.0f, 255.0f);
+    unsigned char amp_val = (unsigned char)Remap(audio.amp_buffer[i], -1.0f, 1.0f, 0.0f, 255.0f);
+    audio.pixel_buffer[i] = (Color){.r = fft_val, .g = amp_val, .b = 0, .a = 0};
+  }
+  UpdateTexture(shader_uniforms.u_buffer, audio.pixel_buffer);
+  audio.level = sqrtf(sum / BUFFER_SIZE);
+  shader_uniforms.u_time = (f32)index / BENCH_FPS;
+  shader_uniforms.u_song_time = shader_uniforms.u_time;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static int bench_compare_paths(const void *a, const void *b)
+{
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Renders every shader offscreen at every size for bench.frames frames and writes the GPU times per frame
+// (mean, median, 95th percentile, min) to bench.out. Returns false if a shader didn't compile or a median
+// is over the budget, so it can gate shader changes. Runs headless like --gpu-fft-selftest.
+bool shader_bench()
+{
+  FilePathList found = {0};
+  if (bench.shader_count == 0)
+  {
+    found = LoadDirectoryFilesEx("shaders", ".frag", false);
+    for (u32 i = 0; i < found.count && bench.shader_count < BENCH_MAX_SHADERS; i++)
+      bench.shaders[bench.shader_count++] = found.paths[i];
+    qsort(bench.shaders, bench.shader_count, sizeof(bench.shaders[0]), bench_compare_paths); // The directory order is arbitrary
+  }
+  f32 *wave = NULL;
+  u32 wave_frames = 0;
+  if (bench.input != NULL)
+  {
+    Wave w = LoadWave(bench.input);
+    WaveFormat(&w, (i32)ANALYSIS_RATE, 32, 1);
+    wave_frames = w.frameCount;
+    wave = wave_frames > 0 ? LoadWaveSamples(w) : NULL;
+    UnloadWave(w);
+    if (wave == NULL)
+    {
+      fprintf(stderr, "Couldn't load [%s] for the benchmark input!\n", bench.input);
+      UnloadDirectoryFiles(found);
+      return false;
+    }
+  }
+  FILE *out = fopen(bench.out, "w");
+  double *times = (double *)malloc(bench.frames * sizeof(double));
+  GpuTimer timer;
+  if (!gpu_timer_init(&timer, bench.frames))
+    fprintf(stderr, "No timer queries, only the wall clock time is measured\n");
+  if (out == NULL || times == NULL)
+  {
+    fprintf(stderr, "Couldn't write [%s]!\n", bench.out);
+    if (out != NULL)
+      fclose(out);
+    free(times);
+    gpu_timer_free(&timer);
+    UnloadWaveSamples(wave);
+    UnloadDirectoryFiles(found);
+    return false;
+  }
+  bool json = IsFileExtension(bench.out, ".json");
+  fprintf(out, json ? "{\n  \"renderer\": \"%s\",\n  \"frames\": %u,\n  \"input\": \"%s\",\n  \"runs\": [" : "# renderer: %s, %u frames, input: %s\n",
+          (const char *)glGetString(GL_RENDERER), bench.frames, bench.input != NULL ? GetFileName(bench.input) : "synthetic");
+  if (!json)
+    fprintf(out, "shader,width,height,gpu_ms_mean,gpu_ms_median,gpu_ms_p95,gpu_ms_min,wall_ms,status\n");
+  Texture2D blank = {.id = rlGetTextureIdDefault(), .width = 1, .height = 1, .mipmaps = 1, .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+  bool passed = true;
+  u32 runs = 0;
+  for (u32 s = 0; s < bench.shader_count; s++)
+  {
+    reload_shader(bench.shaders[s]);
+    bool compiled = ui.shader.id != rlGetShaderIdDefault();
+    passed = passed && compiled;
+    for (const char *size = bench.sizes; size != NULL && *size != '\0'; size = strchr(size, ','), size = size != NULL ? size + 1 : NULL)
+    {
+      i32 width = 0, height = 0;
+      if (sscanf(size, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+        continue;
+      double mean = 0.0, median = 0.0, p95 = 0.0, fastest = 0.0, wall = 0.0;
+      bool over_budget = false;
+      if (compiled)
+      {
+        RenderTexture2D target = LoadRenderTexture(width, height);
+        shader_uniforms.u_resolution = (Vector2){.x = (f32)width, .y = (f32)height};
+        double start = 0.0;
+        for (u32 i = 0; i < BENCH_WARMUP + bench.frames; i++)
+        {
+          if (i == BENCH_WARMUP)
+          {
+            glFinish();
+            start = GetTime();
+          }
+          bench_input(i, wave, wave_frames);
+          BeginTextureMode(target);
+          ClearBackground(BLACK);
+          BeginShaderMode(ui.shader);
+          upload_shader_uniforms(1.0f / BENCH_FPS);
+          rlDrawRenderBatchActive();
+          if (i >= BENCH_WARMUP)
+            gpu_timer_begin(&timer);
+          DrawTexturePro(blank, (Rectangle){.x = 0.f, .y = 0.f, .width = 1.f, .height = -1.f}, (Rectangle){.x = 0.f, .y = 0.f, .width = (f32)width, .height = (f32)height}, (Vector2){0}, 0.0f, BLACK);
+          rlDrawRenderBatchActive();
+          gpu_timer_end(&timer);
+          EndShaderMode();
+          EndTextureMode();
+        }
+        glFinish();
+        wall = (GetTime() - start) / bench.frames * 1000.0;
+        u32 count = gpu_timer_collect(&timer, times);
+        UnloadRenderTexture(target);
+        if (count > 0)
+        {
+          qsort(times, count, sizeof(double), bench_compare);
+          for (u32 i = 0; i < count; i++)
+            mean += times[i] * 1000.0 / count;
+          median = times[count / 2] * 1000.0;
+          p95 = times[(count * 95) / 100 < count ? (count * 95) / 100 : count - 1] * 1000.0;
+          fastest = times[0] * 1000.0;
+        }
+        over_budget = bench.budget_ms > 0.0f && (count > 0 ? median : wall) > bench.budget_ms;
+        passed = passed && !over_budget;
+      }
+      const char *status = !compiled ? "compile_error" : over_budget ? "over_budget" : "ok";
+      const char *name = GetFileName(bench.shaders[s]);
+      if (json)
+        fprintf(out, "%s\n    {\"shader\": \"%s\", \"width\": %d, \"height\": %d, \"gpu_ms_mean\": %.4f, \"gpu_ms_median\": %.4f, "
+                     "\"gpu_ms_p95\": %.4f, \"gpu_ms_min\": %.4f, \"wall_ms\": %.4f, \"status\": \"%s\"}",
+                runs > 0 ? "," : "", name, width, height, mean, median, p95, fastest, wall, status);
+      else
+        fprintf(out, "%s,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%s\n", name, width, height, mean, median, p95, fastest, wall, status);
+      fprintf(stderr, "%-20s %5dx%-5d GPU %8.3f ms median %8.3f ms p95, wall %8.3f ms: %s\n", name, width, height, median, p95, wall, status);
+      runs++;
+    }
+  }
+  if (json)
+    fprintf(out, "\n  ]\n}\n");
+  fclose(out);
+  fprintf(stderr, "Shader benchmark: %u runs written to %s: %s\n", runs, bench.out, passed ? "PASSED" : "FAILED");
+  free(times);
+  gpu_timer_free(&timer);
+  UnloadWaveSamples(wave);
+  UnloadDirectoryFiles(found);
+  return passed;
+}
+
+// Plays a sine sound shader through the readback pipeline for a few seconds. The audio device isn't needed,
+// this loop plays the audio thread and takes as many frames as the real time that passed.
+bool gpu_sound_self_check()
+{
+  // samp % SOUND_RATE keeps the phase exact, 440 periods fit into a second
+  static const char *sine = "vec2 mainSound(int samp, float time)\n"
+                            "{\n"
+                            "  return vec2(0.5 * sin(6.283185307179586 * 440.0 * float(samp % 48000) / 48000.0), 0.25);\n"
+                            "}\n";
+  static f32 period[2 * GPU_SOUND_FIFO];
+  if (!gpu_sound_init(&audio.sound, sine, "self-check", SOUND_RATE))
+    return false;
+  const double seconds = 3.0;
+  double start = -1.0;
+  unsigned long long consumed = 0;
+  f32 error = 0.0f;
+  while (!WindowShouldClose())
+  {
+    BeginDrawing(); // Paced by SetTargetFPS() like the main loop
+    ClearBackground(BLACK);
+    EndDrawing();
+    gpu_sound_update(&audio.sound);
+    if (start < 0.0 && gpu_sound_queued(&audio.sound) >= GPU_SOUND_AHEAD * GPU_SOUND_BLOCK / 2) // Same priming as sound_update()
+      start = GetTime();
+    if (start < 0.0)
+      continue;
+    double now = GetTime() - start;
+    unsigned long long due = (unsigned long long)(now * SOUND_RATE);
+    u32 frames = (u32)(due - consumed < GPU_SOUND_FIFO ? due - consumed : GPU_SOUND_FIFO);
+    u32 got = gpu_sound_read(&audio.sound, period, frames);
+    for (u32 i = 0; i < got; i++)
+    {
+      f32 expected = 0.5f * sinf(2.0f * PI * 440.0f * (f32)((consumed + i) % SOUND_RATE) / (f32)SOUND_RATE);
+      error = fmaxf(error, fmaxf(fabsf(period[2 * i] - expected), fabsf(period[2 * i + 1] - 0.25f)));
+    }
+    consumed += frames; // Underrun frames are lost like on the device
+    if (now > seconds)
+      break;
+  }
+  bool passed = consumed > 0 && audio.sound.underruns == 0 && error < 1e-3f;
+  fprintf(stderr, "Sound shader self-check: %llu frames, %u underruns, error %.2e, readback %.1f ms (max %.1f ms): %s\n",
+          consumed, audio.sound.underruns, error, audio.sound.readback * 1000.0f, audio.sound.readback_max * 1000.0f, passed ? "PASSED" : "FAILED");
+  return passed;
+}
+
+// NOTE: raylib hands the processors the frames after converting them to the mixing format,
+// so they are always float32 with DEVICE_CHANNELS channels at the device sample rate
+void audio_callback(void *bufferData, u32 frames)
+{
+  Tracker *tracker = audio.tracker;
+  if (tracker != NULL) // Follows the stream even while the ring shows the live input
+  {
+    tracker_process(tracker, frames, audio.ring_written);
+  }
+  if (audio.capture.sinking) // The live input owns the ring, already while its device is starting
+    return;
+  ring_push_frames((const f32 *)bufferData, frames, DEVICE_CHANNELS);
+}
+
+// Live input, runs on the capture thread
+void capture_sink(const f32 *frames, u32 frame_count, u32 channels)
+{
+  ring_push_frames(frames, frame_count, channels);
+}
+
+// Mixes the frames down to mono, pushes them into the ring and timestamps them
+void ring_push_frames(const f32 *samples, u32 frames, u32 channels)
+{
+  unsigned long long first = audio.ring_written;
+  for (u32 i = 0; i < frames; i++)
+  {
+    f32 amp = 0;
+    for (u32 j = 0; j < channels; j++)
+    {
+      amp += samples[channels * i + j] / (f32)channels;
+    }
+    push_buffers(amp);
+  }
+
+  // The filterbank runs over the new mono samples right in the ring, in two pieces if they wrap around
+  u32 count = frames < RING_SIZE ? frames : RING_SIZE;
+  u32 start = (u32)((first + frames - count) & (RING_SIZE - 1));
+  u32 head = RING_SIZE - start < count ? RING_SIZE - start : count;
+  filterbank_process(&audio.bank, audio.ring + start, head);
+  if (count > head)
+  {
+    filterbank_process(&audio.bank, audio.ring, count - head);
+  }
+
+  // Timestamp the callback, the main thread interpolates the playhead between two of them
+  double now = clock_time();
+  if (replay.recording)
+  {
+    replay_push_samples(&replay.log, now, audio.ring + start, head, audio.ring, count - head);
+  }
+  audio.period_frames = frames;
+  audio.ring_cb_written = audio.ring_written;
+  audio.ring_cb_time = now;
+  audio.rate_frames += frames;
+  if (audio.rate_time == 0.0)
+  {
+    audio.rate_time = now;
+    audio.rate_frames = 0;
+  }
+  else if (now - audio.rate_time > 1.0) // Measure the device rate over at least a second
+  {
+    f32 rate = (f32)(audio.rate_frames / (now - audio.rate_time));
+    audio.device_rate = audio.device_rate == 0.0f ? rate : 0.8f * audio.device_rate + 0.2f * rate;
+    audio.rate_time = now;
+    audio.rate_frames = 0;
+  }
+}
+
+void push_buffers(f32 value)
+{
+  audio.ring[audio.ring_written & (RING_SIZE - 1)] = value;
+  audio.ring_written++; // Only the audio thread writes this
+}
+
+// Estimated time between a sample being handed to the device and being heard, including the manual offset
+f32 output_latency()
+{
+  if (replay.replaying)
+    return replay.latency;
+  if (audio.capture.active) // Nothing is played back, the newest samples are the ones to show
+  {
+    audio.latency = 0.0f;
+    return audio.latency_offset;
+  }
+  f32 rate = audio.device_rate > 0.0f ? audio.device_rate : (f32)audio.music.stream.sampleRate;
+  if (rate <= 0.0f)
+    return audio.latency_offset;
+  audio.latency = (f32)(audio.period_frames * DEVICE_PERIODS) / rate;
+  return audio.latency + audio.latency_offset;
+}
+
+// Copies the `count` samples that end at `end` out of the ring
+static void ring_copy(unsigned long long end, f32 *out, u32 count)
+{
+  u32 start = (u32)((end - count) & (RING_SIZE - 1));
+  u32 first = RING_SIZE - start < count ? RING_SIZE - start : count;
+  memcpy(out, audio.ring + start, first * sizeof(f32));
+  memcpy(out + first, audio.ring, (count - first) * sizeof(f32));
+}
+
+// Resamples the samples that end at the audible playhead to NFFT samples at ANALYSIS_RATE into fft_in
+// and picks the waveform for amp_buffer from the last BUFFER_SIZE + SCOPE_SEARCH of them at the ring rate
+// Where the analysis window ends, the audible position in the ring
+unsigned long long ring_window_end()
+{
+  f32 rate = audio.device_rate > 0.0f ? audio.device_rate : (f32)audio.music.stream.sampleRate;
+  unsigned long long written = audio.ring_cb_written;
+  audio.window_cb_time = audio.ring_cb_time;
+  double since_cb = audio.paused ? 0.0 : fmin(clock_time() - audio.ring_cb_time, (double)audio.period_frames / rate);
+  long long delay = (long long)((output_latency() - since_cb) * rate); // Samples between the write position and the playhead
+  f32 in_rate = stream_rate();
+  if (audio.decimator.in_rate != in_rate)
+  {
+    decimator_free(&audio.decimator);
+    decimator_init(&audio.decimator, in_rate, ANALYSIS_RATE);
+    audio.window_stale = true;
+  }
+  u32 in_count = decimator_input_length(&audio.decimator, NFFT);
+  if (in_count > RING_SIZE)
+    in_count = RING_SIZE; // Can't happen with the rates stream_rate() returns
+  long long max_delay = RING_SIZE - in_count;
+  if (delay < 0)
+    delay = 0;
+  if (delay > max_delay)
+    delay = max_delay;
+  unsigned long long end = written - (unsigned long long)delay;
+  if (end < in_count)
+    end = in_count; // The ring starts out zeroed
+  return end;
+}
+
+// Reads the analysis window that ends at `end` (ring_window_end()) and the waveform
+void ring_read_window(unsigned long long end)
+{
+  if (audio.decimator.table == NULL) // Its allocation failed
+    return;
+  u32 in_count = decimator_input_length(&audio.decimator, NFFT);
+  if (in_count > RING_SIZE)
+    in_count = RING_SIZE;
+  audio.window_end = end;
+  ring_copy(end, audio.decimator_in, in_count);
+  decimator_run(&audio.decimator, audio.decimator_in, in_count, audio.fft_in, NFFT);
+  ring_copy(end, audio.scope_in, BUFFER_SIZE + SCOPE_SEARCH);
+  shader_uniforms.u_scope_offset = scope_trigger(&audio.scope, audio.scope_in, audio.amp_buffer);
+}
+
+// Rewrites the newest part of the ring with decoded samples that end at `frame`, used after seeking
+void ring_refill(const PcmBuffer *pcm, size_t frame)
+{
+  static f32 tmp[RING_SIZE / 2];
+  pcm_buffer_read_mono(pcm, (long long)frame - RING_SIZE / 2, tmp, RING_SIZE / 2);
+  ring_overwrite(tmp, RING_SIZE / 2);
+}
+
+// Replaces the newest `count` samples of the ring
+void ring_overwrite(const f32 *samples, u32 count)
+{
+  unsigned long long written = audio.ring_written;
+  for (u32 i = 0; i < count; i++)
+  {
+    audio.ring[(written - count + i) & (RING_SIZE - 1)] = samples[i];
+  }
+  audio.window_stale = true; // A seek while paused doesn't move the window
+  if (replay.recording)
+  {
+    replay_write_samples(&replay.log, REPLAY_REFILL, clock_time(), samples, count);
+  }
+}
+
+// Picks the frame rate: the refresh rate of the monitor the window is on, LOW_POWER_FPS while nothing moves
+// (paused, minimized, hidden, nothing loaded) and the mouse is left alone, or uncapped without vsync for benchmarks
+void scheduler_update()
+{
+  i32 monitor = GetCurrentMonitor();
+  if (scheduler.display_fps == 0 || monitor != scheduler.monitor) // Also when the window moved to another monitor
+  {
+    scheduler.monitor = monitor;
+    scheduler.display_fps = GetMonitorRefreshRate(monitor);
+    if (scheduler.display_fps <= 0)
+      scheduler.display_fps = 60;
+  }
+  double now = GetTime();
+  Vector2 mouse_delta = GetMouseDelta();
+  if (mouse_delta.x != 0.0f || mouse_delta.y != 0.0f || IsMouseButtonDown(MOUSE_BUTTON_LEFT) || GetMouseWheelMove() != 0.0f)
+    scheduler.last_input = now;
+  bool playing = audio.capture.active || ((audio.audio_loaded || audio.sound.ready) && !audio.paused);
+  bool hidden = IsWindowMinimized() || IsWindowHidden();
+  i32 target = scheduler.display_fps;
+  if (scheduler.benchmark)
+  {
+    scheduler.mode = FRAME_MODE_BENCHMARK;
+    target = 0;
+  }
+  else if (hidden || (!playing && now - scheduler.last_input > LOW_POWER_DELAY))
+  {
+    scheduler.mode = FRAME_MODE_LOW_POWER;
+    target = LOW_POWER_FPS;
+  }
+  else
+  {
+    scheduler.mode = FRAME_MODE_DISPLAY; // FRAME_MODE_IDLE if scheduler_analyse() skips the analysis
+  }
+  if (scheduler.benchmark == IsWindowState(FLAG_VSYNC_HINT))
+  {
+    if (scheduler.benchmark)
+      ClearWindowState(FLAG_VSYNC_HINT);
+    else
+      SetWindowState(FLAG_VSYNC_HINT);
+  }
+  if (target != scheduler.target_fps)
+  {
+    scheduler.target_fps = target;
+    SetTargetFPS(target);
+  }
+
+  scheduler.frames++;
+  if (now - scheduler.stats_reset > STATS_WINDOW)
+  {
+    scheduler.fps = (f32)(scheduler.frames / (now - scheduler.stats_reset));
+    scheduler.analysis_fps = (f32)(scheduler.analysed / (now - scheduler.stats_reset));
+    scheduler.frames = 0;
+    scheduler.analysed = 0;
+    scheduler.stats_reset = now;
+    plugin_host_reset_stats(&plugins);
+    for (u32 i = 0; i < outputs.count; i++)
+      outputs.outputs[i].gpu_ms_max = 0.0f;
+  }
+}
+
+// Whether the analysis runs this frame. It's skipped when the window ends where the last one did (paused,
+// no new samples), the textures still hold its result then. Benchmarks always run it.
+bool scheduler_analyse(unsigned long long window_end)
+{
+  bool analyse = scheduler.benchmark || audio.window_stale || window_end != audio.window_end;
+  if (analyse)
+  {
+    scheduler.analysed++;
+    audio.window_stale = false;
+  }
+  else if (scheduler.mode == FRAME_MODE_DISPLAY)
+  {
+    scheduler.mode = FRAME_MODE_IDLE;
+  }
+  return analyse;
+}
+
+// Analyses the window that is audible now, unless the scheduler skips it. Returns whether it ran.
+bool analysis_frame()
+{
+  unsigned long long window_end = ring_window_end();
+  bool analysed = scheduler_analyse(window_end);
+  if (analysed) // Otherwise the textures still hold the analysis of this window
+  {
+    ring_read_window(window_end);
+    fft_prepare();
+    if (audio.gpu_fft)
+    {
+      gpu_fft_run(&audio.gpu, audio.fft_in_windowed, audio.amp_buffer, clock_frame_time() * (f32)FACTOR);
+    }
+    else
+    {
+      fft(audio.fft_in_windowed, audio.fft_out, 1, NFFT);
+      fft_postprocess();
+    }
+    analysis_update();
+  }
+  plugins_update(analysed);
+  return analysed;
+}
+
+// Picks up what the plugins delivered since the last frame and hands them this hop, never waits for them.
+// A replay calls them right here instead, so every run gets the same results whatever the workers' timing.
+void plugins_update(bool analysed)
+{
+  if (plugins.count == 0)
+    return;
+  if (!replay.replaying && plugin_host_collect(&plugins, audio.plugin_rows[0], audio.plugin_values) > 0)
+  {
+    UpdateTexture(shader_uniforms.u_plugins, audio.plugin_rows);
+  }
+  if (!analysed)
+    return;
+  ring_copy(audio.window_end, audio.plugin_samples, PLUGIN_SAMPLES);
+  CssPluginInput input = {
+      .abi_version = CSS_PLUGIN_ABI_VERSION,
+      .samples = audio.plugin_samples,
+      .sample_count = PLUGIN_SAMPLES,
+      .sample_rate = stream_rate(),
+      .spectrum_db = audio.gpu_fft ? NULL : audio.fft_smooth,
+      .bins = BUFFER_SIZE,
+      .nfft = NFFT,
+      .analysis_rate = ANALYSIS_RATE,
+      .hop = audio.hops++,
+      .time = clock_time(),
+      .delta_time = clock_frame_time(), // Of the first call, the host measures the later ones per plugin
+      .song_time = audible_song_time(),
+  };
+  if (replay.replaying)
+  {
+    plugin_host_run(&plugins, &input, audio.plugin_rows[0], audio.plugin_values);
+    UpdateTexture(shader_uniforms.u_plugins, audio.plugin_rows);
+    return;
+  }
+  plugin_host_dispatch(&plugins, &input);
+}
+
+// One line of the stats overlay, TextFormat() only has a few static buffers so every line is drawn right away
+static void stats_line(i32 *y, const char *text)
+{
+  const i32 font_size = 20;
+  Rectangle bounds = {.x = ui.window_size.x - 560.0f, .y = (f32)*y, .width = 550.0f, .height = font_size + 4};
+  DrawRectangleRec(bounds, Fade(BLACK, 0.6f));
+  DrawText(text, (i32)bounds.x + 8, *y + 2, font_size, WHITE);
+  *y += font_size + 4;
+}
+
+void toggle_capture(CaptureKind kind, const char *wav_path)
+{
+  if (audio.capture.active)
+  {
+    capture_stop(&audio.capture);
+    fprintf(stderr, "Stopped live input\n");
+  }
+  else if (capture_start(&audio.capture, kind, audio.capture_period, wav_path, capture_sink))
+  {
+    fprintf(stderr, "Live input: %s (%u Hz, %u frames period)\n", audio.capture.name, audio.capture.sample_rate, audio.capture.period_frames);
+    audio.device_rate = (f32)audio.capture.sample_rate;
+    audio.rate_time = 0.0; // Measure again for the new source
+    audio.capture_latency = 0.0f;
+  }
+  audio.period_frames = 0;
+}
+
+// Time from the newest sample of the analysis window being captured to the frame showing it being presented
+void measure_capture_latency()
+{
+  if (!audio.capture.active || audio.window_cb_time <= 0.0 || audio.device_rate <= 0.0f)
+    return;
+  double now = GetTime();
+  // The first sample of a period was captured a whole period before the callback got it
+  f32 latency = (f32)(now - audio.window_cb_time) + (f32)audio.period_frames / audio.device_rate;
+  audio.capture_latency = audio.capture_latency == 0.0f ? latency : 0.95f * audio.capture_latency + 0.05f * latency;
+  audio.capture_latency_max = fmaxf(audio.capture_latency_max, latency);
+  if (now - audio.capture_latency_reset > STATS_WINDOW)
+  {
+    audio.capture_latency_max_shown = audio.capture_latency_max;
+    audio.capture_latency_max = 0.0f;
+    audio.capture_latency_reset = now;
+  }
+}
+
+// Usage: CShaderSound [files...] [--capture | --loopback | --capture-wav file.wav] [--period frames]
+void parse_args(int argc, char **argv)
+{
+  CaptureKind capture_kind = CAPTURE_DEVICE;
+  const char *capture_wav = NULL;
+  const char *sound_path = NULL;
+  bool capture = false;
+  for (i32 i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--capture") == 0)
+    {
+      capture = true;
+      capture_kind = CAPTURE_DEVICE;
+    }
+    else if (strcmp(argv[i], "--loopback") == 0)
+    {
+      capture = true;
+      capture_kind = CAPTURE_LOOPBACK;
+    }
+    else if (strcmp(argv[i], "--capture-wav") == 0 && i + 1 < argc)
+    {
+      capture = true;
+      capture_kind = CAPTURE_WAV;
+      capture_wav = argv[++i];
+    }
+    else if (strcmp(argv[i], "--gpu-fft") == 0)
+    {
+      toggle_gpu_fft();
+    }
+    else if (strcmp(argv[i], "--gpu-fft-selftest") == 0)
+    {
+      ui.run_self_check = true;
+      return;
+    }
+    else if (strcmp(argv[i], "--sound-shader") == 0 && i + 1 < argc)
+    {
+      sound_path = argv[++i];
+    }
+    else if (strcmp(argv[i], "--sound-selftest") == 0)
+    {
+      ui.run_sound_check = true;
+      return;
+    }
+    else if (strcmp(argv[i], "--cqt") == 0)
+    {
+      toggle_cqt();
+    }
+    else if (strcmp(argv[i], "--zoom") == 0 && i + 2 < argc)
+    {
+      f32 low = (f32)atof(argv[++i]);
+      f32 high = (f32)atof(argv[++i]);
+      if (low >= 0.0f && high > low && high <= 0.5f * ANALYSIS_RATE)
+      {
+        audio.zoom_low = low;
+        audio.zoom_high = high;
+      }
+      else
+      {
+        fprintf(stderr, "Invalid zoom band [%s %s]!\n", argv[i - 1], argv[i]);
+      }
+    }
+    else if (strcmp(argv[i], "--scope-trigger") == 0 && i + 1 < argc)
+    {
+      i++;
+      for (u32 mode = 0; mode < SCOPE_TRIGGER_COUNT; mode++)
+      {
+        if (strcmp(argv[i], scope_trigger_names[mode]) == 0)
+          audio.scope.mode = (ScopeTrigger)mode;
+      }
+    }
+    else if (strcmp(argv[i], "--publish") == 0 && i + 1 < argc)
+    {
+      if (analysis_shm_create(&audio.publish, argv[++i], ANALYSIS_ROWS, NFFT, ANALYSIS_RATE))
+        fprintf(stderr, "Publishing the analysis to [%s]\n", argv[i]);
+    }
+    else if (strcmp(argv[i], "--shader-bench") == 0)
+    {
+      bench.run = true;
+    }
+    else if (strcmp(argv[i], "--bench-shader") == 0 && i + 1 < argc)
+    {
+      i++;
+      if (bench.shader_count < BENCH_MAX_SHADERS)
+        bench.shaders[bench.shader_count++] = argv[i];
+    }
+    else if (strcmp(argv[i], "--bench-sizes") == 0 && i + 1 < argc)
+    {
+      bench.sizes = argv[++i];
+    }
+    else if (strcmp(argv[i], "--bench-frames") == 0 && i + 1 < argc)
+    {
+      bench.frames = (u32)atoi(argv[++i]);
+      if (bench.frames == 0)
+        bench.frames = 1;
+    }
+    else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc)
+    {
+      bench.out = argv[++i];
+    }
+    else if (strcmp(argv[i], "--bench-input") == 0 && i + 1 < argc)
+    {
+      bench.input = argv[++i];
+    }
+    else if (strcmp(argv[i], "--bench-budget") == 0 && i + 1 < argc)
+    {
+      bench.budget_ms = (f32)atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--benchmark") == 0)
+    {
+      scheduler.benchmark = true;
+    }
+    else if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc)
+    {
+      i++;
+      for (u32 quality = 0; quality < QUALITY_COUNT; quality++)
+      {
+        if (strcmp(argv[i], shader_quality_names[quality]) == 0)
+          ui.quality = quality;
+      }
+    }
+    else if (strcmp(argv[i], "--visuals") == 0 && i + 1 < argc)
+    {
+      visuals_load(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--visuals-interval") == 0 && i + 1 < argc)
+    {
+      visuals.interval = (f32)atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--visuals-beats") == 0 && i + 1 < argc)
+    {
+      visuals.beats = (u32)atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--visuals-fade") == 0 && i + 1 < argc)
+    {
+      visuals.fade = fmaxf((f32)atof(argv[++i]), 0.0f);
+    }
+    else if (strcmp(argv[i], "--norm-half-life") == 0 && i + 1 < argc)
+    {
+      audio.norm_half_life = fmaxf((f32)atof(argv[++i]), 0.01f);
+    }
+    else if (strcmp(argv[i], "--ttff-target") == 0 && i + 1 < argc)
+    {
+      startup.target_ms = (f32)atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--ttff-check") == 0)
+    {
+      startup.check = true;
+    }
+    else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+    {
+      record_start(argv[++i]); // Before anything is loaded below
+    }
+    else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+    {
+      replay.replay_path = argv[++i];
+    }
+    else if (strcmp(argv[i], "--replay-out") == 0 && i + 1 < argc)
+    {
+      replay.out = argv[++i];
+    }
+    else if (strcmp(argv[i], "--replay-budget") == 0 && i + 1 < argc)
+    {
+      replay.budget_ms = (f32)atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--outputs") == 0 && i + 1 < argc)
+    {
+      u32 cols = 0, rows = 0;
+      if (sscanf(argv[++i], "%ux%u", &cols, &rows) != 2 || cols == 0 || rows == 0 || cols * rows > OUTPUT_MAX)
+      {
+        fprintf(stderr, "--outputs takes COLSxROWS, at most %d outputs!\n", OUTPUT_MAX);
+        continue;
+      }
+      outputs.cols = cols;
+      outputs.rows = rows;
+      outputs.count = cols * rows;
+    }
+    else if (strcmp(argv[i], "--output-gap") == 0 && i + 1 < argc)
+    {
+      outputs.gap = fmaxf((f32)atof(argv[++i]), 0.0f);
+    }
+    else if (strcmp(argv[i], "--output-shader") == 0 && i + 2 < argc)
+    {
+      i32 index = atoi(argv[++i]);
+      const char *path = argv[++i];
+      if (index < 0 || index >= OUTPUT_MAX)
+        fprintf(stderr, "There is no output %d!\n", index);
+      else if (!shader_source_load(&outputs.outputs[index].source, path)) // Compiled when it's first drawn
+        fprintf(stderr, "Couldn't read [%s] for output %d!\n", path, index);
+    }
+    else if (strcmp(argv[i], "--plugin") == 0 && i + 1 < argc)
+    {
+      plugin_host_load(&plugins, argv[++i]);
+    }
+    else if (strcmp(argv[i], "--plugin-budget") == 0 && i + 1 < argc)
+    {
+      plugins.budget_ms = (f32)atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--period") == 0 && i + 1 < argc)
+    {
+      audio.capture_period = (u32)atoi(argv[++i]);
+    }
+    else if (strncmp(argv[i], "--", 2) == 0)
+    {
+      fprintf(stderr, "Unknown option [%s]!\n", argv[i]);
+    }
+    else if (IsFileExtension(argv[i], ".m3u;.m3u8"))
+    {
+      playlist_load_m3u(&ui.playlist, argv[i]);
+    }
+    else
+    {
+      playlist_append(&ui.playlist, argv[i]);
+    }
+  }
+  if (replay.replay_path != NULL) // The log is the only source
+  {
+    return;
+  }
+  if (capture)
+  {
+    toggle_capture(capture_kind, capture_wav);
+  }
+  else if (sound_path != NULL)
+  {
+    start_sound_shader(sound_path);
+  }
+  else if (!audio.audio_loaded && playlist_has_next(&ui.playlist))
+  {
+    load_audio(playlist_next(&ui.playlist));
   }
-  // Update shader uniform with the smoothed values
-  UpdateTexture(shader_uniforms.u_buffer, audio.pixel_buffer);
 }
 
-void audio_callback(void *bufferData, u32 frames)
+// --visuals: a shader, an .m3u of shaders or a directory (its .frag files, sorted). The first one is drawn first.
+void visuals_load(const char *path)
 {
-  u32 ch = audio.music.stream.channels;
-  f32 amp = 0;
-  for (u32 i = 0; i < frames; i++)
+  if (IsFileExtension(path, ".m3u;.m3u8"))
+  {
+    playlist_load_m3u(&visuals.shaders, path);
+  }
+  else if (DirectoryExists(path))
+  {
+    FilePathList found = LoadDirectoryFilesEx(path, ".frag", false);
+    qsort(found.paths, found.count, sizeof(found.paths[0]), bench_compare_paths); // The directory order is arbitrary
+    playlist_append_many(&visuals.shaders, found.paths, found.count);
+    UnloadDirectoryFiles(found);
+  }
+  else
+  {
+    playlist_append(&visuals.shaders, path);
+  }
+  if (visuals.shaders.current < 0 && visuals.shaders.count > 0)
+  {
+    visuals.shaders.current = 0;
+    snprintf(ui.shader_filepath, MAX_STRING_LEN, "%s", playlist_get(&visuals.shaders, 0));
+  }
+}
+
+void *visuals_thread_func(void *arg)
+{
+  (void)arg;
+  shader_source_load(&visuals.next_source, playlist_get(&visuals.shaders, visuals.next));
+  visuals.read_done = true;
+  return NULL;
+}
+
+void visuals_unload_next()
+{
+  if (visuals.next_shader.id != 0)
+    UnloadShader(visuals.next_shader); // Leaves raylib's default shader alone
+  visuals.next_shader = (Shader){0};
+}
+
+// Called before BeginDrawing() on every frame that draws the shader. The next shader is prepared in steps on
+// separate frames (read on a worker, compiled, drawn once offscreen so the driver finishes its part), right
+// after the previous switch, so the crossfade itself only draws two shaders that are ready.
+void visuals_update(Texture2D blank)
+{
+  if (visuals.shaders.count < 2)
+    return;
+  double now = GetTime();
+  if (visuals.shown == 0.0)
+    visuals.shown = now;
+  if (audio.beat_time != visuals.last_beat)
+  {
+    visuals.last_beat = audio.beat_time;
+    visuals.beats_shown++;
+  }
+  if ((visuals.interval > 0.0f && now - visuals.shown >= visuals.interval) || (visuals.beats > 0 && visuals.beats_shown >= visuals.beats))
+    visuals.requested = true;
+  if ((visuals.state == VISUALS_WARMING || visuals.state == VISUALS_READY) && (visuals.next_quality != ui.quality || visuals.next_rate != ui.shader_rate))
+  {
+    visuals_unload_next(); // Compiled again from next_source on the next frame
+    visuals.state = VISUALS_READING;
+  }
+  i32 width = (i32)ui.canvas_bounds.width, height = (i32)ui.canvas_bounds.height;
+  if (visuals.state >= VISUALS_WARMING && (visuals.target.texture.width != width || visuals.target.texture.height != height))
+  {
+    UnloadRenderTexture(visuals.target);
+    visuals.target = LoadRenderTexture(width, height);
+  }
+
+  switch (visuals.state)
+  {
+  case VISUALS_IDLE:
+    if (visuals.failed + 1 >= visuals.shaders.count) // None of the others can be read or compiled
+      break;
+    visuals.next = (visuals.shaders.current + 1 + visuals.failed) % visuals.shaders.count;
+    visuals.read_done = false;
+    visuals.state = VISUALS_READING;
+    visuals.thread_running = pthread_create(&visuals.thread, NULL, visuals_thread_func, NULL) == 0;
+    if (!visuals.thread_running)
+      visuals_thread_func(NULL);
+    break;
+  case VISUALS_READING:
+    if (!visuals.read_done)
+      break;
+    if (visuals.thread_running)
+      pthread_join(visuals.thread, NULL);
+    visuals.thread_running = false;
+    if (visuals.next_source.body != NULL)
+    {
+      visuals.next_quality = ui.quality;
+      visuals.next_rate = ui.shader_rate;
+      visuals.next_shader = compile_shader_variant(&visuals.next_source, visuals.next_quality, visuals.next_rate);
+      visuals.next_locs = shader_locs(visuals.next_shader);
+    }
+    if (visuals.next_source.body == NULL || visuals.next_shader.id == rlGetShaderIdDefault()) // The errors are on stderr
+    {
+      fprintf(stderr, "Skipping [%s] in the visuals playlist\n", GetFileName(playlist_get(&visuals.shaders, visuals.next)));
+      shader_source_free(&visuals.next_source);
+      visuals_unload_next();
+      visuals.failed++;
+      visuals.state = VISUALS_IDLE;
+      break;
+    }
+    visuals.failed = 0;
+    visuals.state = VISUALS_WARMING;
+    break;
+  case VISUALS_WARMING:
+    if (visuals.warm_timer.queries == NULL)
+      gpu_timer_init(&visuals.warm_timer, 1);
+    double unused;
+    if (visuals.warm_timer.used > 0 && gpu_timer_poll(&visuals.warm_timer, &unused) == 0)
+      break; // The warm-up of a variant that was dropped is still in flight
+    visuals.warm_ms = 0.0f;
+    BeginTextureMode(visuals.target);
+    BeginShaderMode(visuals.next_shader);
+    set_shader_values(visuals.next_shader, &visuals.next_locs, shader_uniforms.u_resolution);
+    rlDrawRenderBatchActive();
+    gpu_timer_begin(&visuals.warm_timer);
+    DrawTexturePro(blank, (Rectangle){.x = 0.f, .y = 0.f, .width = 1.f, .height = -1.f}, (Rectangle){.x = 0.f, .y = 0.f, .width = VISUALS_WARM_SIZE, .height = VISUALS_WARM_SIZE}, (Vector2){0}, 0.0f, BLACK);
+    rlDrawRenderBatchActive();
+    gpu_timer_end(&visuals.warm_timer);
+    EndShaderMode();
+    EndTextureMode();
+    visuals.state = VISUALS_READY;
+    break;
+  case VISUALS_READY:
+  {
+    double seconds = 0.0;
+    if (gpu_timer_poll(&visuals.warm_timer, &seconds) > 0)
+      visuals.warm_ms = (f32)(seconds * 1000.0);
+    if (!visuals.requested)
+      break;
+    if (visuals.warm_timer.used > 0) // Not measured yet, the fade waits a frame rather than starting blind
+      break;
+    i32 fps = scheduler.target_fps > 0 ? scheduler.target_fps : scheduler.display_fps > 0 ? scheduler.display_fps : 60;
+    visuals.budget = 1.0f / (f32)fps;
+    visuals.progress = 0.0f;
+    // The warm-up draw scaled to the canvas predicts what the incoming shader costs at full resolution, the
+    // resolution is halved until it fits its share of the budget, so the first fade frame doesn't miss it
+    // already. Without timer queries it starts at full resolution and only the halving below is left.
+    f32 full_ms = visuals.warm_ms * ui.canvas_bounds.width * ui.canvas_bounds.height / (f32)(VISUALS_WARM_SIZE * VISUALS_WARM_SIZE);
+    visuals.scale = 1.0f;
+    while (visuals.scale > 0.25f && full_ms * visuals.scale * visuals.scale > VISUALS_FADE_SHARE * visuals.budget * 1000.0f)
+      visuals.scale *= 0.5f;
+    visuals.start_scale = visuals.scale;
+    visuals.fade_frames = 0;
+    visuals.over_budget = 0;
+    visuals.fade_max = 0.0f;
+    visuals.state = VISUALS_FADING;
+    break;
+  }
+  case VISUALS_FADING:
   {
-    switch (audio.music.stream.sampleSize)
+    f32 dt = GetFrameTime();
+    if (visuals.fade_frames > 0) // The last frame was one of the fade
     {
-    case 8:
-      amp = 0;
-      for (i32 j = 0; j < ch; j++)
+      visuals.fade_max = fmaxf(visuals.fade_max, dt);
+      if (dt > 1.25f * visuals.budget) // A missed vsync shows up as twice the budget, the jitter stays well below
       {
-        amp += ((f32)(((unsigned char *)bufferData)[ch * i + j] - 127) / 256.0f) / (f32)ch;
+        visuals.over_budget++;
+        visuals.scale = fmaxf(visuals.scale * 0.5f, 0.25f);
       }
-      push_buffers(amp);
+    }
+    visuals.fade_frames++;
+    visuals.progress += visuals.fade > 0.0f ? dt / visuals.fade : 1.0f;
+    if (visuals.progress < 1.0f)
       break;
-    case 16:
-      amp = 0;
-      for (i32 j = 0; j < ch; j++)
+    // The incoming shader takes over with the source it was compiled from
+    unload_shader_variants();
+    shader_source_free(&ui.shader_source);
+    ui.shader_source = visuals.next_source;
+    memset(&visuals.next_source, 0, sizeof(visuals.next_source));
+    snprintf(ui.shader_filepath, MAX_STRING_LEN, "%s", playlist_get(&visuals.shaders, visuals.next));
+    ui.shader_variants[visuals.next_quality] = visuals.next_shader;
+    ui.shader_rate = visuals.next_rate;
+    visuals.next_shader = (Shader){0};
+    use_shader_variant(ui.quality); // Only compiles if the tier was switched during the fade
+    visuals.shaders.current = (i32)visuals.next;
+    visuals.shown = now;
+    visuals.beats_shown = 0;
+    visuals.requested = false;
+    visuals.state = VISUALS_IDLE;
+    fprintf(stderr, "Visuals: %s after a %u frame fade, worst frame %.1f ms (budget %.1f ms, %u over), started at %.0f%% resolution (warm-up %.3f ms)\n",
+            GetFileName(ui.shader_filepath), visuals.fade_frames, visuals.fade_max * 1000.0f, visuals.budget * 1000.0f, visuals.over_budget,
+            visuals.start_scale * 100.0f, visuals.warm_ms);
+    break;
+  }
+  }
+}
+
+// Inside BeginDrawing(), after the outgoing shader: draws the incoming one into the target and blends it over.
+// It starts at the resolution the warm-up predicted to fit the budget, a frame that went over budget anyway
+// halves it for the rest of the fade. With --outputs it's blended over the tiles the main shader is drawn
+// into, like the main shader itself.
+void visuals_draw(Texture2D blank)
+{
+  if (visuals.state != VISUALS_FADING)
+    return;
+  Vector2 size = {.x = ui.canvas_bounds.width * visuals.scale, .y = ui.canvas_bounds.height * visuals.scale};
+  BeginTextureMode(visuals.target);
+  ClearBackground(BLANK);
+  BeginShaderMode(visuals.next_shader);
+  set_shader_values(visuals.next_shader, &visuals.next_locs, size);
+  DrawTexturePro(blank, (Rectangle){.x = 0.f, .y = 0.f, .width = 1.f, .height = -1.f}, (Rectangle){.x = 0.f, .y = 0.f, .width = size.x, .height = size.y}, (Vector2){0}, 0.0f, BLACK);
+  EndShaderMode();
+  EndTextureMode();
+  // Render textures are upside down
+  Color tint = Fade(WHITE, fminf(visuals.progress, 1.0f));
+  f32 top = (f32)visuals.target.texture.height;
+  if (outputs.count == 0)
+  {
+    Rectangle source = {.x = 0.0f, .y = top - size.y, .width = size.x, .height = -size.y};
+    DrawTexturePro(visuals.target.texture, source, ui.canvas_bounds, (Vector2){0}, 0.0f, tint);
+    return;
+  }
+  // Only over the tiles of the main shader, the gaps and the outputs with their own shader stay as they are
+  for (u32 i = 0; i < outputs.count; i++)
+  {
+    const Output *o = &outputs.outputs[i];
+    if (o->shader.id != 0)
+      continue;
+    f32 x = (o->bounds.x - ui.canvas_bounds.x) * visuals.scale, y = (o->bounds.y - ui.canvas_bounds.y) * visuals.scale;
+    f32 width = o->bounds.width * visuals.scale, height = o->bounds.height * visuals.scale;
+    Rectangle source = {.x = x, .y = top - y - height, .width = width, .height = -height};
+    DrawTexturePro(visuals.target.texture, source, o->bounds, (Vector2){0}, 0.0f, tint);
+  }
+}
+
+// Splits the canvas into the grid of outputs, again whenever the window is resized
+void outputs_layout()
+{
+  if (outputs.count == 0)
+    return;
+  Rectangle canvas = ui.canvas_bounds;
+  f32 width = fmaxf((canvas.width - (outputs.cols - 1) * outputs.gap) / outputs.cols, 1.0f);
+  f32 height = fmaxf((canvas.height - (outputs.rows - 1) * outputs.gap) / outputs.rows, 1.0f);
+  for (u32 i = 0; i < outputs.count; i++)
+  {
+    Output *o = &outputs.outputs[i];
+    f32 x = (f32)(i % outputs.cols) * (width + outputs.gap);
+    f32 y = (f32)(i / outputs.cols) * (height + outputs.gap);
+    o->bounds = (Rectangle){.x = canvas.x + x, .y = canvas.y + y, .width = width, .height = height};
+    // fragTexCoord of the tile is where it sits on the canvas (y up), so a shader draws one picture across all of them
+    o->wall = (Rectangle){.x = x / canvas.width, .y = 1.0f - (y + height) / canvas.height, .width = width / canvas.width, .height = -height / canvas.height};
+    for (u32 j = 0; j < OUTPUT_TIMERS; j++)
+      if (o->timers[j].queries == NULL)
+        gpu_timer_init(&o->timers[j], 1);
+  }
+}
+
+// Compiles the outputs' own shaders for the quality and the rate the main one has
+void outputs_update()
+{
+  for (u32 i = 0; i < outputs.count; i++)
+  {
+    Output *o = &outputs.outputs[i];
+    if (o->source.body == NULL || (o->shader.id != 0 && o->quality == ui.quality && o->rate == ui.shader_rate))
+      continue;
+    if (o->shader.id != 0)
+      UnloadShader(o->shader);
+    o->quality = ui.quality;
+    o->rate = ui.shader_rate;
+    o->shader = compile_shader_variant(&o->source, o->quality, o->rate);
+    o->locs = shader_locs(o->shader);
+  }
+}
+
+// Draws every output with the analysis and the uniform upload of this frame, the tiles with the main shader
+// and the others with their own. Only the loose uniforms are set per output, raylib unbinds the textures
+// after every batch. Every draw is timed on the GPU, the results are read when they are available (a swap
+// doesn't mean the GPU is done with the frame), waiting for them would serialize what is measured.
+void outputs_draw(Texture2D blank)
+{
+  for (u32 i = 0; i < outputs.count; i++)
+  {
+    Output *o = &outputs.outputs[i];
+    for (u32 j = 0; j < OUTPUT_TIMERS; j++)
+    {
+      double seconds = 0.0;
+      if (gpu_timer_poll(&o->timers[j], &seconds) == 0)
+        continue;
+      f32 ms = (f32)(seconds * 1000.0);
+      o->gpu_ms = o->gpu_ms == 0.0f ? ms : 0.9f * o->gpu_ms + 0.1f * ms;
+      o->gpu_ms_max = fmaxf(o->gpu_ms_max, ms);
+    }
+    GpuTimer *timer = &o->timers[o->frame++ % OUTPUT_TIMERS];
+    bool timed = timer->used == 0; // Still pending OUTPUT_TIMERS frames later, this draw goes unmeasured
+    bool own = o->shader.id != 0;
+    Shader shader = own ? o->shader : ui.shader;
+    BeginShaderMode(shader);
+    set_shader_values(shader, own ? &o->locs : &shader_uniforms.locs, own ? (Vector2){.x = o->bounds.width, .y = o->bounds.height} : shader_uniforms.u_resolution);
+    rlDrawRenderBatchActive();
+    if (timed)
+      gpu_timer_begin(timer);
+    DrawTexturePro(blank, own ? (Rectangle){.x = 0.f, .y = 0.f, .width = 1.f, .height = -1.f} : o->wall, o->bounds, (Vector2){0}, 0.0f, BLACK);
+    rlDrawRenderBatchActive();
+    gpu_timer_end(timer); // Nothing if it wasn't begun
+  }
+}
+
+void outputs_free()
+{
+  for (u32 i = 0; i < OUTPUT_MAX; i++)
+  {
+    Output *o = &outputs.outputs[i];
+    if (o->shader.id != 0)
+      UnloadShader(o->shader);
+    shader_source_free(&o->source);
+    for (u32 j = 0; j < OUTPUT_TIMERS; j++)
+      gpu_timer_free(&o->timers[j]);
+  }
+  memset(&outputs, 0, sizeof(outputs));
+}
+
+void visuals_free()
+{
+  if (visuals.thread_running)
+    pthread_join(visuals.thread, NULL);
+  shader_source_free(&visuals.next_source);
+  visuals_unload_next();
+  UnloadRenderTexture(visuals.target);
+  gpu_timer_free(&visuals.warm_timer);
+  playlist_destroy(&visuals.shaders);
+  memset(&visuals, 0, sizeof(visuals));
+}
+
+// Monotonic seconds, unlike GetTime() it works before InitWindow()
+double startup_clock()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Starts the workers, before InitWindow() so they overlap with the window and context creation.
+// If a thread can't be started its work is done right away.
+void startup_begin()
+{
+  startup.start = startup_clock();
+  startup.audio_started = pthread_create(&startup.audio_thread, NULL, startup_audio_func, NULL) == 0;
+  if (!startup.audio_started)
+    startup_audio_func(NULL);
+  startup.font_started = pthread_create(&startup.font_thread, NULL, startup_font_func, NULL) == 0;
+  if (!startup.font_started)
+    startup_font_func(NULL);
+  startup.assets_started = pthread_create(&startup.assets_thread, NULL, startup_assets_func, NULL) == 0;
+  if (!startup.assets_started)
+    startup_assets_func(NULL);
+}
+
+void startup_join(pthread_t thread, bool *started)
+{
+  if (*started)
+    pthread_join(thread, NULL);
+  *started = false;
+}
+
+// miniaudio opens the device from any thread, nothing else may touch the audio until it's joined
+void *startup_audio_func(void *arg)
+{
+  (void)arg;
+  double start = startup_clock();
+  InitAudioDevice();
+  startup.audio_ms = (f32)((startup_clock() - start) * 1000.0);
+  return NULL;
+}
+
+// What LoadFontEx() does, without the texture upload
+void *startup_font_func(void *arg)
+{
+  (void)arg;
+  double start = startup_clock();
+  i32 size = 0;
+  unsigned char *data = LoadFileData(FONT_FILE, &size);
+  if (data != NULL)
+  {
+    startup.glyphs = LoadFontData(data, size, FONT_SIZE, NULL, FONT_GLYPHS, FONT_DEFAULT);
+    UnloadFileData(data);
+  }
+  if (startup.glyphs != NULL)
+  {
+    startup.atlas = GenImageFontAtlas(startup.glyphs, &startup.recs, FONT_GLYPHS, FONT_SIZE, FONT_PADDING, 0);
+    for (i32 i = 0; i < FONT_GLYPHS; i++) // The glyph images come from the atlas, like LoadFontEx() does it
+    {
+      UnloadImage(startup.glyphs[i].image);
+      startup.glyphs[i].image = ImageFromImage(startup.atlas, startup.recs[i]);
+    }
+  }
+  startup.font_ms = (f32)((startup_clock() - start) * 1000.0);
+  return NULL;
+}
+
+void *startup_assets_func(void *arg)
+{
+  (void)arg;
+  double start = startup_clock();
+  startup.icon = LoadImage("icon.png");
+  shader_source_load(&startup.shader, DEFAULT_SHADER);
+  startup.assets_ms = (f32)((startup_clock() - start) * 1000.0);
+  return NULL;
+}
+
+// Uploads the atlas startup_font_func() packed, raylib's default font if there is none
+Font startup_font()
+{
+  if (startup.glyphs == NULL)
+    return GetFontDefault();
+  Font font = {.baseSize = FONT_SIZE, .glyphCount = FONT_GLYPHS, .glyphPadding = FONT_PADDING, .glyphs = startup.glyphs, .recs = startup.recs};
+  font.texture = LoadTextureFromImage(startup.atlas);
+  UnloadImage(startup.atlas);
+  startup.glyphs = NULL;
+  startup.recs = NULL;
+  return font;
+}
+
+// After the first EndDrawing(), reports how long it took and how the workers did
+void startup_first_frame()
+{
+  startup.first_frame_ms = (f32)((startup_clock() - startup.start) * 1000.0);
+  fprintf(stderr, "First frame after %.0f ms (target %.0f ms): window %.0f ms, on the workers audio %.0f ms, font %.0f ms, icon and shader %.0f ms\n",
+          startup.first_frame_ms, startup.target_ms, startup.window_ms, startup.audio_ms, startup.font_ms, startup.assets_ms);
+  if (startup.first_frame_ms > startup.target_ms)
+    fprintf(stderr, "Startup is slower than the target of %.0f ms!\n", startup.target_ms);
+}
+
+// GetTime() for everything the analysis and the drawing depend on, the recorded time while replaying
+double clock_time()
+{
+  return replay.replaying ? replay.time : GetTime();
+}
+
+// GetFrameTime() for the analysis and the drawing, the recorded one while replaying
+f32 clock_frame_time()
+{
+  return replay.replaying ? replay.frame_time : GetFrameTime();
+}
+
+// --record, the log is written until the program quits
+void record_start(const char *path)
+{
+  if (!replay_create(&replay.log, path, BUFFER_SIZE, NFFT))
+    return;
+  replay.record_path = path;
+  replay.recording = true;
+  fprintf(stderr, "Recording the session to %s\n", path);
+}
+
+// Before the analysis of every drawn frame: logs the inputs that changed since the last one and the frame.
+// The audio blocks queued so far are written out first, so the log stays in time order.
+void record_frame()
+{
+  double now = GetTime();
+  Vector2 size = {.x = ui.canvas_bounds.width, .y = ui.canvas_bounds.height};
+  if (size.x != replay.size.x || size.y != replay.size.y)
+  {
+    replay.size = size;
+    replay_write(&replay.log, REPLAY_RESIZE, now, &size, sizeof(size));
+  }
+  unsigned char payload[sizeof(uint32_t) + MAX_STRING_LEN];
+  if (ui.quality != replay.quality || strcmp(ui.shader_filepath, replay.shader) != 0)
+  {
+    uint32_t quality = ui.quality;
+    u32 length = (u32)strlen(ui.shader_filepath);
+    memcpy(payload, &quality, sizeof(quality));
+    memcpy(payload + sizeof(quality), ui.shader_filepath, length);
+    replay_write(&replay.log, REPLAY_SHADER, now, payload, sizeof(quality) + length);
+    replay.quality = ui.quality;
+    strcpy(replay.shader, ui.shader_filepath);
+  }
+  f32 rate = stream_rate();
+  if (rate != replay.rate || strcmp(ui.music_name, replay.track) != 0)
+  {
+    u32 length = (u32)strlen(ui.music_name);
+    memcpy(payload, &rate, sizeof(rate));
+    memcpy(payload + sizeof(rate), ui.music_name, length);
+    replay_write(&replay.log, REPLAY_TRACK, now, payload, sizeof(rate) + length);
+    replay.rate = rate;
+    strcpy(replay.track, ui.music_name);
+  }
+  if (audio.paused != replay.paused)
+  {
+    uint32_t paused = audio.paused;
+    replay_write(&replay.log, REPLAY_PAUSE, now, &paused, sizeof(paused));
+    replay.paused = audio.paused;
+  }
+  f32 frame[3] = {GetFrameTime(), audible_song_time(), output_latency()};
+  replay_write(&replay.log, REPLAY_FRAME, now, frame, sizeof(frame));
+  replay.frames++;
+}
+
+void record_stop()
+{
+  if (!replay.recording)
+    return;
+  replay.recording = false;
+  replay_flush(&replay.log);
+  fprintf(stderr, "Recorded %u frames, %.1f MB to %s\n", replay.frames, replay.log.bytes / (1024.0 * 1024.0), replay.record_path);
+  if (replay.log.dropped > 0)
+    fprintf(stderr, "%u audio blocks didn't fit into the queue, the replay misses them!\n", replay.log.dropped);
+  replay_close(&replay.log);
+}
+
+// --replay: feeds a --record log through the analysis and the drawing as fast as it goes. The audio blocks go
+// into the ring at their recorded times and every recorded frame is analysed and drawn offscreen on the
+// recorded clock, so a log gives the same frames on every run. Reports the time per frame (the analysis, and
+// the whole frame up to glFinish()) and returns false if the 95th percentile is over --replay-budget.
+// The analysis settings (--gpu-fft, --cqt, ...) are the ones of this run, the same log can compare them.
+bool replay_run()
+{
+  if (!replay_open(&replay.log, replay.replay_path))
+    return false;
+  FILE *out = replay.out != NULL ? fopen(replay.out, "w") : NULL;
+  if (replay.out != NULL && out == NULL)
+    fprintf(stderr, "Couldn't write [%s]!\n", replay.out);
+  if (out != NULL)
+    fprintf(out, "frame,time,recorded_ms,analysed,analysis_ms,frame_ms\n");
+  static f32 samples[REPLAY_MAX_PAYLOAD / sizeof(int16_t)];
+  double *times = NULL, *analysis_times = NULL;
+  u32 capacity = 0, frames = 0, analysed_frames = 0, blocks = 0, seeks = 0;
+  double first_time = -1.0, last_time = 0.0;
+  bool failed = false;
+  Texture2D blank = {.id = rlGetTextureIdDefault(), .width = 1, .height = 1, .mipmaps = 1, .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+  RenderTexture2D target = {0};
+  replay.replaying = true;
+  double start = GetTime();
+  while (!failed && replay_next(&replay.log))
+  {
+    const ReplayRecord *record = &replay.log.record;
+    const unsigned char *payload = replay.log.payload;
+    replay.time = record->time;
+    if (first_time < 0.0)
+      first_time = record->time;
+    last_time = record->time;
+    switch (record->type)
+    {
+    case REPLAY_AUDIO:
+    case REPLAY_REFILL:
+    {
+      u32 count = record->size / sizeof(int16_t);
+      for (u32 i = 0; i < count; i++)
+      {
+        int16_t sample;
+        memcpy(&sample, payload + i * sizeof(sample), sizeof(sample));
+        samples[i] = (f32)sample / 32767.0f;
+      }
+      if (record->type == REPLAY_AUDIO)
+      {
+        ring_push_frames(samples, count, 1); // Mono already, the mixdown leaves it as it is
+        blocks++;
+      }
+      else
       {
-        amp += ((f32)(((short *)bufferData)[ch * i + j]) / 32767.0f) / (f32)ch;
+        ring_overwrite(samples, count);
       }
-      push_buffers(amp);
       break;
-    case 32:
-      amp = 0;
-      for (i32 j = 0; j < ch; j++)
+    }
+    case REPLAY_SEEK:
+      seeks++; // The samples after it are in the log, a decoded track's refill too
+      break;
+    case REPLAY_RESIZE:
+    {
+      Vector2 size = {0};
+      memcpy(&size, payload, record->size < sizeof(size) ? record->size : sizeof(size));
+      ui.canvas_bounds.width = size.x;
+      ui.canvas_bounds.height = size.y;
+      shader_uniforms.u_resolution = size;
+      break;
+    }
+    case REPLAY_SHADER:
+    {
+      uint32_t quality = 0;
+      if (record->size <= sizeof(quality))
+        break;
+      memcpy(&quality, payload, sizeof(quality));
+      ui.quality = quality < QUALITY_COUNT ? quality : QUALITY_HIGH;
+      reload_shader((const char *)payload + sizeof(quality));
+      break;
+    }
+    case REPLAY_TRACK:
+    {
+      f32 rate = 0.0f;
+      if (record->size < sizeof(rate))
+        break;
+      memcpy(&rate, payload, sizeof(rate));
+      audio.music.stream.sampleRate = (u32)rate; // stream_rate() until the device rate is measured from the blocks
+      snprintf(ui.music_name, MAX_STRING_LEN, "%s", (const char *)payload + sizeof(rate));
+      break;
+    }
+    case REPLAY_PAUSE:
+    {
+      uint32_t paused = 0;
+      memcpy(&paused, payload, record->size < sizeof(paused) ? record->size : sizeof(paused));
+      audio.paused = paused != 0;
+      break;
+    }
+    case REPLAY_FRAME:
+    {
+      f32 frame[3] = {0};
+      memcpy(frame, payload, record->size < sizeof(frame) ? record->size : sizeof(frame));
+      replay.frame_time = frame[0];
+      replay.song_time = frame[1];
+      replay.latency = frame[2];
+      if (stream_rate() != ui.shader_rate) // Same as the main loop, but outside of the measured frame
+        reload_shader(ui.shader_filepath);
+      i32 width = (i32)ui.canvas_bounds.width, height = (i32)ui.canvas_bounds.height;
+      if (target.texture.width != width || target.texture.height != height)
       {
-        amp += (((f32 *)bufferData)[ch * i + j]) / (f32)ch;
+        if (target.id != 0)
+          UnloadRenderTexture(target);
+        target = LoadRenderTexture(width, height);
+      }
+      if (frames == capacity)
+      {
+        capacity = capacity > 0 ? capacity * 2 : 4096;
+        double *grown = (double *)realloc(times, capacity * sizeof(double));
+        times = grown != NULL ? grown : times;
+        grown = grown != NULL ? (double *)realloc(analysis_times, capacity * sizeof(double)) : NULL;
+        analysis_times = grown != NULL ? grown : analysis_times;
+        if (grown == NULL)
+        {
+          fprintf(stderr, "ERROR: Memory allocation failed\n");
+          failed = true;
+          break;
+        }
       }
-      push_buffers(amp);
+      double frame_start = GetTime();
+      plugins.run_ms = 0.0f;
+      bool analysed = analysis_frame();
+      double analysis_end = GetTime();
+      double plugin_ms = plugins.run_ms; // Off the render thread when live, so not part of the frame
+      BeginTextureMode(target);
+      ClearBackground(BLACK);
+      BeginShaderMode(ui.shader);
+      send_shader_uniforms();
+      DrawTexturePro(blank, (Rectangle){.x = 0.f, .y = 0.f, .width = 1.f, .height = -1.f}, (Rectangle){.x = 0.f, .y = 0.f, .width = (f32)width, .height = (f32)height}, (Vector2){0}, 0.0f, BLACK);
+      EndShaderMode();
+      EndTextureMode();
+      glFinish();
+      times[frames] = (GetTime() - frame_start) * 1000.0 - plugin_ms;
+      analysis_times[frames] = (analysis_end - frame_start) * 1000.0 - plugin_ms;
+      if (out != NULL)
+        fprintf(out, "%u,%.4f,%.3f,%d,%.4f,%.4f\n", frames, record->time, replay.frame_time * 1000.0f, analysed, analysis_times[frames], times[frames]);
+      analysed_frames += analysed;
+      frames++;
       break;
-    default:
-      fprintf(stderr, "Sample size of music (%u) is not supported!\n", audio.music.stream.sampleSize);
-      return;
     }
+    default: // Nothing else is written by this version
+      break;
+    }
+  }
+  replay.replaying = false;
+  double wall = GetTime() - start;
+  bool passed = !failed && frames > 0;
+  if (frames > 0)
+  {
+    double mean = 0.0, analysis_mean = 0.0;
+    for (u32 i = 0; i < frames; i++)
+    {
+      mean += times[i] / frames;
+      analysis_mean += analysis_times[i] / frames;
+    }
+    qsort(times, frames, sizeof(double), bench_compare);
+    qsort(analysis_times, frames, sizeof(double), bench_compare);
+    u32 p95 = (frames * 95) / 100 < frames ? (frames * 95) / 100 : frames - 1;
+    fprintf(stderr, "Replayed %u frames (%u analysed), %u audio blocks and %u seeks, %.1f s of the session in %.2f s\n",
+            frames, analysed_frames, blocks, seeks, last_time - first_time, wall);
+    fprintf(stderr, "Frame %.3f ms mean, %.3f ms median, %.3f ms p95, %.3f ms max; analysis %.3f ms mean, %.3f ms p95\n",
+            mean, times[frames / 2], times[p95], times[frames - 1], analysis_mean, analysis_times[p95]);
+    for (u32 i = 0; i < plugins.count; i++)
+    {
+      const Plugin *p = &plugins.plugins[i];
+      fprintf(stderr, "Plugin %u: %s, %.3f ms avg, %.3f ms max over %u hops (called in line, not part of the frame times)\n", i,
+              p->api->name != NULL ? p->api->name : GetFileName(p->path), p->run_avg_ms, p->run_max_ms, p->run_count);
+    }
+    if (replay.budget_ms > 0.0f && times[p95] > replay.budget_ms)
+    {
+      fprintf(stderr, "The 95th percentile is over the budget of %.2f ms!\n", replay.budget_ms);
+      passed = false;
+    }
+  }
+  else if (!failed)
+  {
+    fprintf(stderr, "There are no frames in [%s]!\n", replay.replay_path);
   }
+  fprintf(stderr, "Replay: %s\n", passed ? "PASSED" : "FAILED");
+  if (out != NULL)
+    fclose(out);
+  if (target.id != 0)
+    UnloadRenderTexture(target);
+  free(times);
+  free(analysis_times);
+  replay_close(&replay.log);
+  return passed;
 }
 
-void push_buffers(f32 value)
+void stats_draw()
 {
-  memmove(audio.fft_in, audio.fft_in + 1, (NFFT - 1) * sizeof(audio.fft_in[0])); // Move everything to the left
-  audio.fft_in[NFFT - 1] = value;                                                // Updating the most recent value
-  memmove(audio.amp_buffer, audio.amp_buffer + 1, (BUFFER_SIZE - 1) * sizeof(audio.amp_buffer[0]));
-  audio.amp_buffer[BUFFER_SIZE - 1] = value;
+  if (!ui.show_stats)
+    return;
+  i32 y = 10;
+  stats_line(&y, TextFormat("FPS: %d (%.2f ms)", GetFPS(), GetFrameTime() * 1000.0f));
+  stats_line(&y, TextFormat("Scheduler: %s, target %s, %.1f fps, analysis %.1f/s", frame_mode_names[scheduler.mode],
+                            scheduler.target_fps > 0 ? TextFormat("%d Hz", scheduler.target_fps) : "uncapped", scheduler.fps, scheduler.analysis_fps));
+  stats_line(&y, TextFormat("Device: %.0f Hz, period %u frames", audio.device_rate, audio.period_frames));
+  stats_line(&y, TextFormat("Latency: %.1f ms (estimated %.1f ms %+.0f ms offset)", (audio.latency + audio.latency_offset) * 1000.0f, audio.latency * 1000.0f, audio.latency_offset * 1000.0f));
+  stats_line(&y, TextFormat("Song time: %.2f s", shader_uniforms.u_song_time));
+  stats_line(&y, TextFormat("Startup: first frame after %.0f ms (target %.0f ms)", startup.first_frame_ms, startup.target_ms));
+  stats_line(&y, TextFormat("Control bar: %u redraws, %dx%d texture", ui.bar_redraws, ui.bar.texture.width, ui.bar.texture.height));
+  u32 variants = 0;
+  for (u32 quality = 0; quality < QUALITY_COUNT; quality++)
+    variants += ui.shader_variants[quality].id != 0;
+  stats_line(&y, TextFormat("Shader: %s, quality %s (%u of %d variants compiled)", GetFileName(ui.shader_filepath), shader_quality_names[ui.quality], variants, QUALITY_COUNT));
+  if (visuals.shaders.count > 0)
+  {
+    stats_line(&y, TextFormat("Visuals: %d/%u, next %s, last fade worst %.1f ms (budget %.1f, %u over)", visuals.shaders.current + 1, visuals.shaders.count,
+                              visuals_state_names[visuals.state], visuals.fade_max * 1000.0f, visuals.budget * 1000.0f, visuals.over_budget));
+  }
+  stats_line(&y, TextFormat("Analysis: %s, %.0f -> %.0f Hz (%u taps)", audio.gpu_fft ? "GPU (shader passes)" : "CPU", audio.decimator.in_rate, ANALYSIS_RATE, audio.decimator.taps));
+  if (!audio.gpu_fft)
+  {
+    stats_line(&y, TextFormat("Spectrum range: %.1f..%.1f dB (%.0fth-%.0fth percentile, half-life %.1f s)", audio.normalizer.low, audio.normalizer.high,
+                              NORM_LOW_PERCENTILE * 100.0f, NORM_HIGH_PERCENTILE * 100.0f, audio.norm_half_life));
+  }
+  if (shader_uniforms.u_pitch.x > 0.0f)
+  {
+    stats_line(&y, TextFormat("Pitch: %.1f Hz (confidence %.2f)", shader_uniforms.u_pitch.x, shader_uniforms.u_pitch.y));
+  }
+  stats_line(&y, TextFormat("Waveform trigger: %s, start %u samples back", scope_trigger_names[audio.scope.mode], SCOPE_SEARCH - audio.scope.start));
+  stats_line(&y, TextFormat("Filterbank: %u bands, %.0f-%.0f Hz, updated every %u frames", FILTERBANK_BANDS, FILTERBANK_LOW, FILTERBANK_HIGH, audio.period_frames));
+  if (audio.cqt_enabled)
+  {
+    stats_line(&y, TextFormat("Constant-Q: %u bins from %.1f Hz, zoom %.0f-%.0f Hz", audio.cqt.bins, CQT_MIN_FREQ, audio.zoom_low, audio.zoom_high));
+  }
+  if (audio.tracker != NULL)
+  {
+    stats_line(&y, TextFormat("Tracker: %s, %u channels", audio.tracker->kind == TRACKER_XM ? "XM" : "MOD", audio.tracker->channels));
+  }
+  if (audio.sound.ready)
+  {
+    stats_line(&y, TextFormat("Sound shader: %u underruns, queued %.0f ms (min %.0f ms)", audio.sound.underruns,
+                              1000.0f * gpu_sound_queued(&audio.sound) / audio.sound.sample_rate, 1000.0f * fmaxf(audio.sound.queued_min, 0.0f)));
+    stats_line(&y, TextFormat("GPU readback: %.1f ms (max %.1f ms), %u in flight", audio.sound.readback * 1000.0f, audio.sound.readback_max * 1000.0f, audio.sound.inflight));
+  }
+  if (outputs.count > 0)
+  {
+    f32 total = 0.0f;
+    for (u32 i = 0; i < outputs.count; i++)
+      total += outputs.outputs[i].gpu_ms;
+    stats_line(&y, TextFormat("Outputs: %ux%u, %.0f px gap, GPU %.2f ms for all of them", outputs.cols, outputs.rows, outputs.gap, total));
+    for (u32 i = 0; i < outputs.count; i++)
+    {
+      const Output *o = &outputs.outputs[i];
+      stats_line(&y, TextFormat("Output %u: %s %.0fx%.0f, GPU %.2f ms (max %.2f)", i, o->source.body != NULL ? GetFileName(o->source.path) : "tile",
+                                o->bounds.width, o->bounds.height, o->gpu_ms, o->gpu_ms_max));
+    }
+  }
+  for (u32 i = 0; i < plugins.count; i++)
+  {
+    const Plugin *p = &plugins.plugins[i];
+    stats_line(&y, TextFormat("Plugin %u: %s, %.2f ms (avg %.2f, max %.2f), %u skipped%s", i, p->api->name != NULL ? p->api->name : GetFileName(p->path),
+                              p->last_ms, p->avg_ms, p->max_ms, p->skipped, p->interval > 1 ? TextFormat(", every %u hops", p->interval) : ""));
+  }
+  if (replay.recording)
+  {
+    stats_line(&y, TextFormat("Recording: %s, %u frames, %.1f MB, %u blocks dropped", GetFileName(replay.record_path), replay.frames,
+                              replay.log.bytes / (1024.0 * 1024.0), replay.log.dropped));
+  }
+  if (audio.capture.active)
+  {
+    stats_line(&y, TextFormat("Capture -> pixel: %.1f ms (max %.1f ms)", audio.capture_latency * 1000.0f, audio.capture_latency_max_shown * 1000.0f));
+  }
 }
 
 // from: https://github.com/tsoding/musializer and https://rosettacode.org/wiki/Fast_Fourier_transform
@@ -0,0 +1,85 @@
+#pragma once
+#include <string.h>
+
+// Streaming range of the spectrum in dB, for mapping it to the texture without every frame being stretched
+// to its own min and max (quiet passages blown up to full scale, single peaks flattening the rest).
+// Every value goes into a fixed histogram over NORMALIZER_MIN_DB..NORMALIZER_MAX_DB, O(1) per value. Older
+// values fade out exponentially: instead of scaling every bin down each frame, the weight of new values grows
+// and everything is scaled back now and then. The percentiles are found by walking the bins, so a query costs
+// the same however many values went in. Values outside the range land in the edge bins.
+
+#define NORMALIZER_BINS 512 // 0.3125 dB each
+#define NORMALIZER_MIN_DB -80.0f
+#define NORMALIZER_MAX_DB 80.0f
+#define NORMALIZER_RESCALE 1e6f // Weight at which the histogram is scaled back to 1
+
+typedef struct normalizer_s
+{
+  float bins[NORMALIZER_BINS]; // Decayed counts, in units of `weight`
+  float total;
+  float weight;          // Of a value added now
+  float low_percentile;  // 0..1
+  float high_percentile;
+  float min_range;       // dB, low and high are kept at least this far apart
+  float low, high;       // dB at the percentiles, as of the last normalizer_update()
+} Normalizer;
+
+void normalizer_init(Normalizer *n, float low_percentile, float high_percentile, float min_range)
+{
+  memset(n, 0, sizeof(*n));
+  n->weight = 1.0f;
+  n->low_percentile = low_percentile;
+  n->high_percentile = high_percentile;
+  n->min_range = min_range;
+  n->low = 0.0f; // Until there is something in the histogram
+  n->high = min_range;
+}
+
+// `db` has to be finite
+void normalizer_add(Normalizer *n, float db)
+{
+  int bin = (int)((db - NORMALIZER_MIN_DB) * ((float)NORMALIZER_BINS / (NORMALIZER_MAX_DB - NORMALIZER_MIN_DB)));
+  bin = bin < 0 ? 0 : bin >= NORMALIZER_BINS ? NORMALIZER_BINS - 1 : bin;
+  n->bins[bin] += n->weight;
+  n->total += n->weight;
+}
+
+// dB where the cumulative weight reaches `target`, interpolated inside the bin
+static float normalizer_percentile(const Normalizer *n, float target)
+{
+  const float width = (NORMALIZER_MAX_DB - NORMALIZER_MIN_DB) / (float)NORMALIZER_BINS;
+  float sum = 0.0f;
+  for (int i = 0; i < NORMALIZER_BINS; i++)
+  {
+    if (n->bins[i] > 0.0f && sum + n->bins[i] >= target)
+      return NORMALIZER_MIN_DB + width * ((float)i + (target - sum) / n->bins[i]);
+    sum += n->bins[i];
+  }
+  return NORMALIZER_MAX_DB;
+}
+
+// Once per frame after the values were added: updates low and high, then ages everything by `decay` (the
+// weight the values so far keep, 0..1)
+void normalizer_update(Normalizer *n, float decay)
+{
+  if (n->total > 0.0f)
+  {
+    n->low = normalizer_percentile(n, n->total * n->low_percentile);
+    n->high = normalizer_percentile(n, n->total * n->high_percentile);
+    if (n->high - n->low < n->min_range)
+    {
+      float mid = 0.5f * (n->low + n->high);
+      n->low = mid - 0.5f * n->min_range;
+      n->high = mid + 0.5f * n->min_range;
+    }
+  }
+  n->weight /= decay;
+  if (n->weight > NORMALIZER_RESCALE)
+  {
+    float scale = 1.0f / n->weight;
+    for (int i = 0; i < NORMALIZER_BINS; i++)
+      n->bins[i] *= scale;
+    n->total *= scale;
+    n->weight = 1.0f;
+  }
+}
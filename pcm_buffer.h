@@ -0,0 +1,135 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Interleaved float PCM of a whole decoded track.
+// Long tracks are put into a mmap'd temporary file instead of the heap, so the pages we are not
+// playing right now can be written back to disk by the OS instead of sitting in RAM. The file goes into the
+// user's cache directory ($XDG_CACHE_HOME or ~/.cache) because /tmp is often a tmpfs, which is RAM (and swap)
+// itself; $TMPDIR and /tmp are only the fallback, there the mapping doesn't save memory.
+// NOTE: On Windows including windows.h clashes with raylib, so there it's always a plain malloc.
+
+#define PCM_MAP_THRESHOLD (64 * 1024 * 1024) // Bytes, smaller tracks just use malloc
+#define PCM_MAX_PATH 512
+
+typedef struct pcm_buffer_s
+{
+  float *data;
+  size_t frames;
+  unsigned int channels;
+  unsigned int sample_rate;
+  size_t bytes;
+  int mapped; // data was mmap'd and has to be munmap'd
+} PcmBuffer;
+
+#ifndef _WIN32
+// An unlinked temporary file, in the first of the directories that works. Returns -1 on failure.
+static int pcm_temp_file()
+{
+  const char *home = getenv("HOME");
+  const char *cache = getenv("XDG_CACHE_HOME");
+  const char *tmp = getenv("TMPDIR");
+  char dirs[4][PCM_MAX_PATH] = {{0}};
+  if (cache != NULL && cache[0] != '\0')
+    snprintf(dirs[0], PCM_MAX_PATH, "%s", cache);
+  if (home != NULL && home[0] != '\0')
+    snprintf(dirs[1], PCM_MAX_PATH, "%s/.cache", home);
+  if (tmp != NULL && tmp[0] != '\0')
+    snprintf(dirs[2], PCM_MAX_PATH, "%s", tmp);
+  snprintf(dirs[3], PCM_MAX_PATH, "/tmp");
+  for (int i = 0; i < 4; i++)
+  {
+    if (dirs[i][0] == '\0')
+      continue;
+    char path[PCM_MAX_PATH + 32];
+    snprintf(path, sizeof(path), "%s/cshadersound-pcm-XXXXXX", dirs[i]);
+    int fd = mkstemp(path);
+    if (fd >= 0)
+    {
+      unlink(path); // Deleted right away, the mapping keeps the storage alive
+      return fd;
+    }
+  }
+  return -1;
+}
+#endif
+
+// Returns 0 on failure, the buffer is zeroed then
+int pcm_buffer_alloc(PcmBuffer *pcm, size_t frames, unsigned int channels, unsigned int sample_rate)
+{
+  memset(pcm, 0, sizeof(*pcm));
+  size_t bytes = frames * channels * sizeof(float);
+  if (bytes == 0)
+    return 0;
+#ifndef _WIN32
+  if (bytes >= PCM_MAP_THRESHOLD)
+  {
+    int fd = pcm_temp_file();
+    if (fd >= 0)
+    {
+      void *data = MAP_FAILED;
+      if (ftruncate(fd, (off_t)bytes) == 0)
+        data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      if (data != MAP_FAILED)
+      {
+        pcm->data = (float *)data;
+        pcm->mapped = 1;
+      }
+    }
+    if (!pcm->mapped)
+      fprintf(stderr, "WARNING: Couldn't map temporary storage for %zu bytes, using the heap\n", bytes);
+  }
+#endif
+  if (pcm->data == NULL)
+  {
+    pcm->data = (float *)malloc(bytes);
+    if (pcm->data == NULL)
+    {
+      fprintf(stderr, "ERROR: Memory allocation failed\n");
+      return 0;
+    }
+  }
+  pcm->frames = frames;
+  pcm->channels = channels;
+  pcm->sample_rate = sample_rate;
+  pcm->bytes = bytes;
+  return 1;
+}
+
+void pcm_buffer_free(PcmBuffer *pcm)
+{
+  if (pcm->data != NULL)
+  {
+#ifndef _WIN32
+    if (pcm->mapped)
+      munmap(pcm->data, pcm->bytes);
+    else
+#endif
+      free(pcm->data);
+  }
+  memset(pcm, 0, sizeof(*pcm));
+}
+
+// Averages the channels of `count` frames starting at `frame` into `out`, frames outside of the track are 0
+void pcm_buffer_read_mono(const PcmBuffer *pcm, long long frame, float *out, size_t count)
+{
+  for (size_t i = 0; i < count; i++, frame++)
+  {
+    if (frame < 0 || frame >= (long long)pcm->frames)
+    {
+      out[i] = 0.0f;
+      continue;
+    }
+    const float *src = pcm->data + (size_t)frame * pcm->channels;
+    float sum = 0.0f;
+    for (unsigned int c = 0; c < pcm->channels; c++)
+      sum += src[c];
+    out[i] = sum / (float)pcm->channels;
+  }
+}
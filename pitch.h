@@ -0,0 +1,160 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include "cqt.h" // cplx_fft()
+
+// Harmonic features from the spectrum the frame already has.
+// Chroma: every FFT bin between `low` and `high` is folded onto the pitch class it's closest to, weighted
+// down towards the edge between two semitones. The map is built once per sample rate, so a frame is one
+// pass over a flat list of (bin, class, weight).
+// Pitch: YIN on the autocorrelation of the windowed frame, which is the inverse FFT of the power spectrum,
+// so it costs one inverse FFT instead of an O(N^2) lag loop. The autocorrelation is circular, lags near
+// the end alias into the short lags we use, but the window makes that negligible.
+
+#define CHROMA_CLASSES 12 // C, C#, ..., B
+#define YIN_THRESHOLD 0.15f
+
+typedef struct chroma_map_s
+{
+  unsigned int count;
+  unsigned int *bin;
+  unsigned char *pitch_class;
+  float *weight;
+  float sample_rate;
+} ChromaMap;
+
+void chroma_map_free(ChromaMap *map)
+{
+  free(map->bin);
+  free(map->pitch_class);
+  free(map->weight);
+  memset(map, 0, sizeof(*map));
+}
+
+// Returns 0 on failure
+int chroma_map_init(ChromaMap *map, unsigned int n, float sample_rate, float low, float high)
+{
+  memset(map, 0, sizeof(*map));
+  unsigned int first = (unsigned int)ceilf(low * n / sample_rate);
+  unsigned int last = (unsigned int)(high * n / sample_rate);
+  if (last >= n / 2)
+    last = n / 2 - 1;
+  unsigned int cap = (last >= first ? last - first : 0) + 1; // Never 0, malloc(0) may return NULL
+  map->bin = (unsigned int *)malloc(cap * sizeof(unsigned int));
+  map->pitch_class = (unsigned char *)malloc(cap);
+  map->weight = (float *)malloc(cap * sizeof(float));
+  if (!map->bin || !map->pitch_class || !map->weight)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    chroma_map_free(map);
+    return 0;
+  }
+  for (unsigned int k = first; k <= last && k > 0; k++)
+  {
+    double semitone = 12.0 * log2(k * (double)sample_rate / n / 440.0) + 9.0; // Semitones above C4
+    double nearest = floor(semitone + 0.5);
+    double offset = semitone - nearest; // -0.5 .. 0.5
+    double weight = cos(3.14159265358979323846 * offset);
+    map->bin[map->count] = k;
+    map->pitch_class[map->count] = (unsigned char)(((int)nearest % CHROMA_CLASSES + CHROMA_CLASSES) % CHROMA_CLASSES);
+    map->weight[map->count] = (float)(weight * weight);
+    map->count++;
+  }
+  map->sample_rate = sample_rate;
+  return 1;
+}
+
+// Pitch class energies of the spectrum, not normalized
+void chroma_compute(const ChromaMap *map, const float complex *spectrum, float *chroma)
+{
+  memset(chroma, 0, CHROMA_CLASSES * sizeof(float));
+  for (unsigned int i = 0; i < map->count; i++)
+  {
+    float complex x = spectrum[map->bin[i]];
+    chroma[map->pitch_class[i]] += map->weight[i] * (crealf(x) * crealf(x) + cimagf(x) * cimagf(x));
+  }
+}
+
+typedef struct yin_s
+{
+  unsigned int n;
+  float complex *acf; // Scratch for the inverse FFT, n
+  float *energy;      // Prefix sums of the squared frame, n + 1
+  float *cmnd;        // Cumulative mean normalized difference, n / 2
+} Yin;
+
+void yin_free(Yin *yin)
+{
+  free(yin->acf);
+  free(yin->energy);
+  free(yin->cmnd);
+  memset(yin, 0, sizeof(*yin));
+}
+
+// Returns 0 on failure
+int yin_init(Yin *yin, unsigned int n)
+{
+  memset(yin, 0, sizeof(*yin));
+  yin->n = n;
+  yin->acf = (float complex *)malloc(n * sizeof(float complex));
+  yin->energy = (float *)malloc((n + 1) * sizeof(float));
+  yin->cmnd = (float *)malloc(n / 2 * sizeof(float));
+  if (!yin->acf || !yin->energy || !yin->cmnd)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    yin_free(yin);
+    return 0;
+  }
+  return 1;
+}
+
+// Fundamental frequency in Hz between `low` and `high`, 0 if the frame isn't periodic enough.
+// `spectrum` is the n point FFT of `windowed`, `confidence` gets 1 - the normalized difference at the period.
+float yin_estimate(Yin *yin, const float complex *spectrum, const float *windowed, float sample_rate, float low, float high, float *confidence)
+{
+  const unsigned int n = yin->n;
+  unsigned int min_lag = (unsigned int)(sample_rate / high);
+  unsigned int max_lag = (unsigned int)(sample_rate / low) + 1;
+  if (max_lag >= n / 2)
+    max_lag = n / 2 - 1;
+  *confidence = 0.0f;
+  if (min_lag < 2 || min_lag >= max_lag)
+    return 0.0f;
+
+  for (unsigned int k = 0; k < n; k++)
+  {
+    float complex x = spectrum[k];
+    yin->acf[k] = crealf(x) * crealf(x) + cimagf(x) * cimagf(x);
+  }
+  cplx_fft(yin->acf, n, 1); // Real part / n is the autocorrelation
+  yin->energy[0] = 0.0f;
+  for (unsigned int i = 0; i < n; i++)
+    yin->energy[i + 1] = yin->energy[i] + windowed[i] * windowed[i];
+
+  // d(lag) = sum over the overlap of (x[j] - x[j + lag])^2 = energy of both parts - 2 r(lag)
+  float sum = 0.0f;
+  unsigned int period = 0;
+  yin->cmnd[0] = 1.0f;
+  for (unsigned int lag = 1; lag <= max_lag; lag++)
+  {
+    float r = crealf(yin->acf[lag]) / (float)n;
+    float d = (yin->energy[n - lag] - yin->energy[0]) + (yin->energy[n] - yin->energy[lag]) - 2.0f * r;
+    d = fmaxf(d, 0.0f);
+    sum += d;
+    yin->cmnd[lag] = sum > 0.0f ? d * lag / sum : 1.0f;
+    if (period == 0 && lag > min_lag && yin->cmnd[lag - 1] < YIN_THRESHOLD && yin->cmnd[lag] >= yin->cmnd[lag - 1])
+      period = lag - 1; // The bottom of the first dip under the threshold
+  }
+  if (period == 0)
+    return 0.0f;
+
+  // Parabolic interpolation between the neighbouring lags
+  float a = yin->cmnd[period - 1], b = yin->cmnd[period], c = yin->cmnd[period + 1];
+  float denom = a - 2.0f * b + c;
+  float shift = denom > 0.0f ? 0.5f * (a - c) / denom : 0.0f;
+  *confidence = 1.0f - b;
+  return sample_rate / ((float)period + shift);
+}
@@ -0,0 +1,319 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Indexed playlist, replaces the old linked list queue.
+// Every path is interned once into one growing arena (a '\0' separated char buffer) and the play order
+// is just an array of offsets into it, so appending a few thousand dropped files is a handful of reallocs
+// instead of two mallocs per file. Entries are never removed when played, the current position is
+// an index, so going back to the previous track or shuffling what is left is cheap.
+
+#define PLAYLIST_MAX_LINE 1024
+
+typedef struct playlist_s
+{
+  char *arena; // All paths, '\0' terminated, back to back
+  size_t arena_len;
+  size_t arena_cap;
+  unsigned int *order; // Offsets into the arena in play order
+  unsigned int count;
+  unsigned int cap;
+  unsigned int *table; // Open addressing hash set of arena offsets + 1 (0 is an empty slot) for interning
+  unsigned int table_cap;
+  unsigned int table_len;
+  int current; // Index into order of the track that is playing, -1 if nothing was played yet
+} Playlist;
+
+void playlist_init(Playlist *pl)
+{
+  memset(pl, 0, sizeof(*pl));
+  pl->current = -1;
+}
+
+void playlist_destroy(Playlist *pl)
+{
+  free(pl->arena);
+  free(pl->order);
+  free(pl->table);
+  playlist_init(pl);
+}
+
+// Removes every entry but keeps the memory around
+void playlist_clear(Playlist *pl)
+{
+  pl->arena_len = 0;
+  pl->count = 0;
+  pl->table_len = 0;
+  if (pl->table)
+    memset(pl->table, 0, pl->table_cap * sizeof(pl->table[0]));
+  pl->current = -1;
+}
+
+static unsigned int playlist_hash(const char *str)
+{
+  unsigned int h = 2166136261u; // FNV-1a
+  for (; *str; str++)
+  {
+    h ^= (unsigned char)*str;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static int playlist_grow_table(Playlist *pl, unsigned int min_cap)
+{
+  unsigned int new_cap = pl->table_cap ? pl->table_cap : 64;
+  while (new_cap < min_cap)
+    new_cap *= 2;
+  if (new_cap == pl->table_cap)
+    return 1;
+  unsigned int *new_table = (unsigned int *)calloc(new_cap, sizeof(unsigned int));
+  if (!new_table)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    return 0;
+  }
+  for (unsigned int i = 0; i < pl->table_cap; i++) // Rehash
+  {
+    if (pl->table[i] == 0)
+      continue;
+    unsigned int slot = playlist_hash(pl->arena + pl->table[i] - 1) & (new_cap - 1);
+    while (new_table[slot] != 0)
+      slot = (slot + 1) & (new_cap - 1);
+    new_table[slot] = pl->table[i];
+  }
+  free(pl->table);
+  pl->table = new_table;
+  pl->table_cap = new_cap;
+  return 1;
+}
+
+// Makes room for `n` more entries with about `bytes` of path data, so bulk inserts only allocate once
+int playlist_reserve(Playlist *pl, unsigned int n, size_t bytes)
+{
+  if (pl->count + n > pl->cap)
+  {
+    unsigned int new_cap = pl->cap ? pl->cap : 64;
+    while (new_cap < pl->count + n)
+      new_cap *= 2;
+    unsigned int *new_order = (unsigned int *)realloc(pl->order, new_cap * sizeof(unsigned int));
+    if (!new_order)
+    {
+      fprintf(stderr, "ERROR: Memory allocation failed\n");
+      return 0;
+    }
+    pl->order = new_order;
+    pl->cap = new_cap;
+  }
+  if (pl->arena_len + bytes > pl->arena_cap)
+  {
+    size_t new_cap = pl->arena_cap ? pl->arena_cap : 4096;
+    while (new_cap < pl->arena_len + bytes)
+      new_cap *= 2;
+    char *new_arena = (char *)realloc(pl->arena, new_cap);
+    if (!new_arena)
+    {
+      fprintf(stderr, "ERROR: Memory allocation failed\n");
+      return 0;
+    }
+    pl->arena = new_arena;
+    pl->arena_cap = new_cap;
+  }
+  // Keep the load factor of the interning table under 1/2
+  return playlist_grow_table(pl, 2 * (pl->table_len + n));
+}
+
+// Returns the arena offset of `path`, copying it into the arena if it isn't there yet
+static int playlist_intern(Playlist *pl, const char *path, unsigned int *offset)
+{
+  size_t len = strlen(path) + 1;
+  if (!playlist_reserve(pl, 0, len)) // Before probing, growing the arena can also grow the table
+    return 0;
+  unsigned int slot = playlist_hash(path) & (pl->table_cap - 1);
+  while (pl->table[slot] != 0)
+  {
+    if (strcmp(pl->arena + pl->table[slot] - 1, path) == 0)
+    {
+      *offset = pl->table[slot] - 1;
+      return 1;
+    }
+    slot = (slot + 1) & (pl->table_cap - 1);
+  }
+  memcpy(pl->arena + pl->arena_len, path, len);
+  *offset = (unsigned int)pl->arena_len;
+  pl->arena_len += len;
+  pl->table[slot] = *offset + 1;
+  pl->table_len++;
+  return 1;
+}
+
+// Appends a path to the end of the playlist, returns its index or -1 on failure
+int playlist_append(Playlist *pl, const char *path)
+{
+  if (!playlist_reserve(pl, 1, 0))
+    return -1;
+  unsigned int offset;
+  if (!playlist_intern(pl, path, &offset))
+    return -1;
+  pl->order[pl->count] = offset;
+  return (int)pl->count++;
+}
+
+// Bulk insert (e.g. the paths of a FilePathList), returns how many were added
+unsigned int playlist_append_many(Playlist *pl, char **paths, unsigned int n)
+{
+  size_t bytes = 0;
+  for (unsigned int i = 0; i < n; i++)
+    bytes += strlen(paths[i]) + 1;
+  if (!playlist_reserve(pl, n, bytes))
+    return 0;
+  unsigned int added = 0;
+  for (unsigned int i = 0; i < n; i++)
+  {
+    if (playlist_append(pl, paths[i]) >= 0)
+      added++;
+  }
+  return added;
+}
+
+const char *playlist_get(Playlist *pl, unsigned int index)
+{
+  if (index >= pl->count)
+    return NULL;
+  return pl->arena + pl->order[index];
+}
+
+int playlist_has_next(Playlist *pl)
+{
+  return pl->current + 1 < (int)pl->count;
+}
+
+int playlist_has_prev(Playlist *pl)
+{
+  return pl->current > 0;
+}
+
+// NOTE: The returned strings live in the arena, they are only valid until the next insert
+const char *playlist_peek_next(Playlist *pl)
+{
+  return playlist_has_next(pl) ? playlist_get(pl, pl->current + 1) : NULL;
+}
+
+const char *playlist_next(Playlist *pl)
+{
+  if (!playlist_has_next(pl))
+    return NULL;
+  return playlist_get(pl, ++pl->current);
+}
+
+const char *playlist_prev(Playlist *pl)
+{
+  if (!playlist_has_prev(pl))
+    return NULL;
+  return playlist_get(pl, --pl->current);
+}
+
+// Moves the entry at `from` to `to`, the current track keeps playing
+void playlist_move(Playlist *pl, unsigned int from, unsigned int to)
+{
+  if (from >= pl->count || to >= pl->count || from == to)
+    return;
+  unsigned int offset = pl->order[from];
+  if (from < to)
+    memmove(pl->order + from, pl->order + from + 1, (to - from) * sizeof(pl->order[0]));
+  else
+    memmove(pl->order + to + 1, pl->order + to, (from - to) * sizeof(pl->order[0]));
+  pl->order[to] = offset;
+  if (pl->current == (int)from)
+    pl->current = (int)to;
+  else if ((int)from < pl->current && (int)to >= pl->current)
+    pl->current--;
+  else if ((int)from > pl->current && (int)to <= pl->current)
+    pl->current++;
+}
+
+// Shuffles the tracks that weren't played yet (Fisher-Yates), so the history stays intact
+void playlist_shuffle(Playlist *pl)
+{
+  unsigned int first = (unsigned int)(pl->current + 1);
+  for (unsigned int i = pl->count; i > first + 1; i--)
+  {
+    unsigned int j = first + (unsigned int)(rand() % (int)(i - first));
+    unsigned int tmp = pl->order[i - 1];
+    pl->order[i - 1] = pl->order[j];
+    pl->order[j] = tmp;
+  }
+}
+
+// Appends every entry of an .m3u/.m3u8 file, relative paths are resolved against the file's directory
+// Returns the number of added entries or -1 if the file couldn't be opened
+int playlist_load_m3u(Playlist *pl, const char *file_path)
+{
+  FILE *file = fopen(file_path, "r");
+  if (!file)
+  {
+    fprintf(stderr, "ERROR: Couldn't open playlist [%s]\n", file_path);
+    return -1;
+  }
+  char dir[PLAYLIST_MAX_LINE] = {0};
+  const char *slash = strrchr(file_path, '/');
+  const char *backslash = strrchr(file_path, '\\');
+  if (backslash > slash)
+    slash = backslash;
+  if (slash && (size_t)(slash - file_path) + 1 < sizeof(dir))
+    memcpy(dir, file_path, (size_t)(slash - file_path) + 1);
+
+  char line[PLAYLIST_MAX_LINE];
+  char path[2 * PLAYLIST_MAX_LINE];
+  int added = 0;
+  while (fgets(line, sizeof(line), file))
+  {
+    char *start = line;
+    if ((unsigned char)start[0] == 0xEF && (unsigned char)start[1] == 0xBB && (unsigned char)start[2] == 0xBF)
+      start += 3; // UTF-8 BOM (.m3u8)
+    size_t len = strlen(start);
+    while (len > 0 && (start[len - 1] == '\n' || start[len - 1] == '\r' || start[len - 1] == ' '))
+      start[--len] = '\0';
+    if (len == 0 || start[0] == '#') // Empty line or #EXTM3U/#EXTINF
+      continue;
+    int absolute = start[0] == '/' || start[0] == '\\' || (len > 1 && start[1] == ':');
+    snprintf(path, sizeof(path), "%s%s", absolute ? "" : dir, start);
+    if (playlist_append(pl, path) >= 0)
+      added++;
+  }
+  fclose(file);
+  return added;
+}
+
+// Writes the whole playlist as an extended m3u, returns 0 on failure
+int playlist_save_m3u(Playlist *pl, const char *file_path)
+{
+  FILE *file = fopen(file_path, "w");
+  if (!file)
+  {
+    fprintf(stderr, "ERROR: Couldn't write playlist [%s]\n", file_path);
+    return 0;
+  }
+  fprintf(file, "#EXTM3U\n");
+  for (unsigned int i = 0; i < pl->count; i++)
+  {
+    fprintf(file, "%s\n", playlist_get(pl, i));
+  }
+  fclose(file);
+  return 1;
+}
+
+void playlist_print(Playlist *pl)
+{
+  if (pl->count == 0)
+  {
+    printf("The playlist is empty!\n");
+    return;
+  }
+  printf("Playlist:\n");
+  for (unsigned int i = 0; i < pl->count; i++)
+  {
+    printf("%s %s\n", (int)i == pl->current ? ">" : " ", playlist_get(pl, i));
+  }
+}
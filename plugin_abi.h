@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+
+// The C interface of analysis plugins, the only header a plugin needs (no raylib). A plugin is a shared
+// library that exports CSS_PLUGIN_ENTRY, a function returning its CssPlugin. Every analysis hop it gets the
+// newest samples and the spectrum and writes its own row of the uPlugins texture and its uniform slots
+// (uPluginValues). process() runs on a worker thread, never on the render thread, and only one call per plugin
+// is in flight at a time, so a plugin's state needs no locking. Everything in CssPluginInput is only valid
+// during the call.
+// Compatible changes only append members to the structs; a plugin built against another version is refused.
+// See examples/plugin_flux.c.
+
+#define CSS_PLUGIN_ABI_VERSION 1
+#define CSS_PLUGIN_ENTRY "css_plugin_entry"
+
+#ifdef _WIN32
+#define CSS_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define CSS_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+typedef struct css_plugin_input_s
+{
+  uint32_t abi_version;
+  const float *samples;  // Mono, the newest sample_count of them, ending at the audible position
+  uint32_t sample_count;
+  float sample_rate;     // Of samples
+  const float *spectrum_db; // Smoothed magnitude in dB like uBuffer, bin i is i * analysis_rate / nfft Hz.
+                            // NULL with the GPU analysis, the spectrum only exists on the GPU then.
+  uint32_t bins;
+  uint32_t nfft;
+  float analysis_rate;
+  uint64_t hop;          // Hops analysed before this one
+  double time;           // Seconds since the program started
+  float delta_time;      // Since this plugin's last call, hops it skipped (busy or throttled) included
+  float song_time;       // Audible position in the track
+} CssPluginInput;
+
+typedef struct css_plugin_output_s
+{
+  float *row;            // The plugin's row of uPlugins, row_size texels, kept between calls
+  uint32_t row_size;
+  float *values;         // Its uniform slots, uPluginValues[slot * value_count + i], kept between calls
+  uint32_t value_count;
+} CssPluginOutput;
+
+typedef struct css_plugin_s
+{
+  uint32_t abi_version; // CSS_PLUGIN_ABI_VERSION the plugin was built against
+  const char *name;
+  void *(*create)(void);          // State passed to the other functions, may be NULL
+  void (*destroy)(void *state);   // Before the library is unloaded (quitting or reloading it)
+  void (*process)(void *state, const CssPluginInput *in, CssPluginOutput *out);
+} CssPlugin;
+
+typedef const CssPlugin *(*CssPluginEntry)(void);
@@ -0,0 +1,445 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <link.h> // ElfW()
+#endif
+#include "plugin_abi.h"
+
+// Loads analysis plugins (plugin_abi.h) and runs them on a small pool of worker threads. The render thread
+// only hands out jobs and picks up finished results, it never waits for a plugin: one that is still busy
+// with an earlier hop skips the new one and its row just lags behind. Every call is timed, and a plugin
+// whose average goes over the budget is only scheduled every few hops, so its share of the CPU stays
+// within the budget and it can't crowd the others out of the pool.
+// Hot reload: the libraries are checked for changes now and then. A changed one is loaded from a copy (so
+// the compiler can overwrite the file while it's mapped) next to the old one, and only replaces it if it
+// loads, so a half-written library leaves the old version running. The state starts over with create().
+// A change is the modification time (nanoseconds) or the size, a library that didn't load is tried once more on
+// the next poll in case the linker was still writing it within the same timestamp.
+// Where the results must not depend on timing (--replay) plugin_host_run() calls the plugins right away instead.
+// NOTE: Not available on Windows, loading just fails there.
+
+#define PLUGIN_MAX 8          // Rows of uPlugins
+#define PLUGIN_VALUES 8       // Uniform slots per plugin
+#define PLUGIN_ROW_SIZE 2048  // Texels per row
+#define PLUGIN_SAMPLES 8192   // Newest samples a plugin gets
+#define PLUGIN_BINS 2048      // Spectrum bins a plugin gets at most
+#define PLUGIN_WORKERS 2
+#define PLUGIN_POLL 0.5       // Seconds between checks for changed libraries
+#define PLUGIN_MAX_PATH 512
+
+typedef struct plugin_stamp_s // What tells a changed library apart
+{
+  long long sec;
+  long nsec;
+  long long size;
+} PluginStamp;
+
+typedef struct plugin_s
+{
+  char path[PLUGIN_MAX_PATH];
+  void *library;
+  const CssPlugin *api;
+  void *state;
+  PluginStamp stamp;  // Of the loaded library
+  PluginStamp failed; // Of the last one that didn't load
+  bool retried;       // failed was tried twice, it's only tried again when the library changes
+  unsigned int generation; // Reloads, numbers the copies
+  double last_time;   // CssPluginInput.time of its last call, 0 before the first
+  // The job, only the worker touches it while busy
+  bool busy;
+  bool done;        // A result is waiting for plugin_host_collect()
+  CssPluginInput input;
+  float samples[PLUGIN_SAMPLES];
+  float spectrum[PLUGIN_BINS];
+  float row[PLUGIN_ROW_SIZE];
+  float values[PLUGIN_VALUES];
+  // Time accounting, in ms per call
+  float last_ms;
+  float avg_ms;
+  float max_ms;     // Since plugin_host_reset_stats()
+  unsigned int runs;
+  unsigned int skipped;  // Hops it was still busy with an earlier one or throttled
+  unsigned int interval; // Scheduled every `interval` hops, more than 1 while it's over the budget
+  // plugin_host_run() calls, kept apart so they don't throttle the worker ones
+  float run_avg_ms;
+  float run_max_ms;
+  unsigned int run_count;
+} Plugin;
+
+typedef struct plugin_host_s
+{
+  Plugin plugins[PLUGIN_MAX];
+  unsigned int count;
+  float budget_ms; // Average time per hop a plugin may take
+  pthread_t workers[PLUGIN_WORKERS];
+  unsigned int worker_count;
+  pthread_mutex_t lock; // Guards the queue and the busy and done flags
+  pthread_cond_t wake;
+  unsigned int queue[PLUGIN_MAX]; // A plugin is queued at most once, it's busy until it ran
+  unsigned int queue_head;
+  unsigned int queued;
+  bool stopping;
+  double last_poll;
+  float run_ms; // All plugins took in the last plugin_host_run()
+} PluginHost;
+
+static double plugin_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// All zero if the library doesn't exist
+static PluginStamp plugin_stamp(const char *path)
+{
+  PluginStamp stamp = {0};
+#ifndef _WIN32
+  struct stat st;
+  if (stat(path, &st) == 0)
+  {
+#ifdef __APPLE__
+    stamp.sec = (long long)st.st_mtimespec.tv_sec;
+    stamp.nsec = st.st_mtimespec.tv_nsec;
+#else
+    stamp.sec = (long long)st.st_mtim.tv_sec;
+    stamp.nsec = st.st_mtim.tv_nsec;
+#endif
+    stamp.size = (long long)st.st_size;
+  }
+#endif
+  return stamp;
+}
+
+static bool plugin_stamp_equal(PluginStamp a, PluginStamp b)
+{
+  return a.sec == b.sec && a.nsec == b.nsec && a.size == b.size;
+}
+
+static void *plugin_worker(void *arg)
+{
+  PluginHost *host = (PluginHost *)arg;
+  pthread_mutex_lock(&host->lock);
+  for (;;)
+  {
+    while (host->queued == 0 && !host->stopping)
+      pthread_cond_wait(&host->wake, &host->lock);
+    if (host->stopping)
+      break;
+    Plugin *p = &host->plugins[host->queue[host->queue_head]];
+    host->queue_head = (host->queue_head + 1) % PLUGIN_MAX;
+    host->queued--;
+    pthread_mutex_unlock(&host->lock);
+
+    CssPluginOutput out = {p->row, PLUGIN_ROW_SIZE, p->values, PLUGIN_VALUES};
+    double start = plugin_now();
+    p->api->process(p->state, &p->input, &out);
+    p->last_ms = (float)((plugin_now() - start) * 1000.0);
+    p->avg_ms = p->runs == 0 ? p->last_ms : 0.9f * p->avg_ms + 0.1f * p->last_ms;
+    p->max_ms = fmaxf(p->max_ms, p->last_ms);
+    p->runs++;
+
+    pthread_mutex_lock(&host->lock);
+    p->busy = false;
+    p->done = true;
+  }
+  pthread_mutex_unlock(&host->lock);
+  return NULL;
+}
+
+void plugin_host_init(PluginHost *host, float budget_ms)
+{
+  memset(host, 0, sizeof(*host));
+  host->budget_ms = budget_ms;
+  pthread_mutex_init(&host->lock, NULL);
+  pthread_cond_init(&host->wake, NULL);
+}
+
+static void plugin_close(Plugin *p)
+{
+#ifndef _WIN32
+  if (p->library == NULL)
+    return;
+  if (p->api->destroy != NULL)
+    p->api->destroy(p->state);
+  dlclose(p->library);
+#endif
+  p->library = NULL;
+  p->api = NULL;
+  p->state = NULL;
+}
+
+// Whether the library isn't cut off, dlopen() of a half-written one crashes with SIGBUS instead of failing.
+// Checks that the program headers, their segments and the section headers are all within the file.
+static bool plugin_complete(const char *path)
+{
+#ifdef __linux__
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  ElfW(Ehdr) header;
+  bool complete = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.e_ident, ELFMAG, SELFMAG) == 0 &&
+                  fseek(file, 0, SEEK_END) == 0;
+  long long size = complete ? (long long)ftell(file) : 0;
+  complete = complete && (long long)header.e_phoff + (long long)header.e_phnum * header.e_phentsize <= size &&
+             (long long)header.e_shoff + (long long)header.e_shnum * header.e_shentsize <= size;
+  for (unsigned int i = 0; complete && i < header.e_phnum; i++)
+  {
+    ElfW(Phdr) segment;
+    complete = fseek(file, (long)(header.e_phoff + i * header.e_phentsize), SEEK_SET) == 0 && fread(&segment, sizeof(segment), 1, file) == 1 &&
+               (long long)segment.p_offset + (long long)segment.p_filesz <= size;
+  }
+  fclose(file);
+  return complete;
+#else
+  (void)path;
+  return true;
+#endif
+}
+
+// Remembers a library that didn't load, so it's tried once more and then left until it changes
+static void plugin_failed(Plugin *p, PluginStamp stamp)
+{
+  p->retried = plugin_stamp_equal(stamp, p->failed);
+  p->failed = stamp;
+}
+
+// Loads a copy of p->path and creates its state, p is only changed if that worked. Returns 0 on failure.
+static int plugin_open(Plugin *p)
+{
+#ifndef _WIN32
+  PluginStamp stamp = plugin_stamp(p->path); // Before the copy, a change while copying is picked up next time
+  char copy[PLUGIN_MAX_PATH + 32];
+  snprintf(copy, sizeof(copy), "%s.%u.tmp", p->path, p->generation++);
+  FILE *in = fopen(p->path, "rb");
+  FILE *out = in != NULL ? fopen(copy, "wb") : NULL;
+  bool copied = out != NULL;
+  char buffer[65536];
+  for (size_t n; copied && (n = fread(buffer, 1, sizeof(buffer), in)) > 0;)
+    copied = fwrite(buffer, 1, n, out) == n;
+  if (in != NULL)
+    fclose(in);
+  if (out != NULL)
+    copied = fclose(out) == 0 && copied;
+  if (!copied || !plugin_complete(copy))
+  {
+    if (copied)
+      fprintf(stderr, "The plugin [%s] is cut off, still being written?\n", p->path);
+    else
+      fprintf(stderr, "Couldn't copy the plugin [%s]!\n", p->path);
+    remove(copy);
+    plugin_failed(p, stamp);
+    return 0;
+  }
+  void *library = dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+  remove(copy); // The mapping stays
+  if (library == NULL)
+  {
+    fprintf(stderr, "Couldn't load the plugin [%s]: %s\n", p->path, dlerror());
+    plugin_failed(p, stamp);
+    return 0;
+  }
+  CssPluginEntry entry;
+  *(void **)&entry = dlsym(library, CSS_PLUGIN_ENTRY); // ISO C has no cast from void * to a function pointer
+  const CssPlugin *api = entry != NULL ? entry() : NULL;
+  if (api == NULL || api->abi_version != CSS_PLUGIN_ABI_VERSION || api->process == NULL)
+  {
+    fprintf(stderr, "[%s] isn't a plugin of ABI version %d!\n", p->path, CSS_PLUGIN_ABI_VERSION);
+    dlclose(library);
+    plugin_failed(p, stamp);
+    return 0;
+  }
+  void *state = api->create != NULL ? api->create() : NULL;
+  plugin_close(p); // The old version, not busy, the caller made sure
+  p->library = library;
+  p->api = api;
+  p->state = state;
+  p->stamp = stamp;
+  memset(&p->failed, 0, sizeof(p->failed));
+  p->retried = false;
+  p->last_time = 0.0;
+  p->done = false;
+  p->runs = 0;
+  p->interval = 1;
+  memset(p->row, 0, sizeof(p->row));
+  memset(p->values, 0, sizeof(p->values));
+  return 1;
+#else
+  fprintf(stderr, "Plugins [%s] aren't supported on Windows!\n", p->path);
+  return 0;
+#endif
+}
+
+// Returns the slot of the plugin (its row of uPlugins), -1 on failure
+int plugin_host_load(PluginHost *host, const char *path)
+{
+  if (host->count == PLUGIN_MAX)
+  {
+    fprintf(stderr, "Only %d plugins can be loaded, [%s] isn't!\n", PLUGIN_MAX, path);
+    return -1;
+  }
+  Plugin *p = &host->plugins[host->count];
+  memset(p, 0, sizeof(*p));
+  snprintf(p->path, PLUGIN_MAX_PATH, "%s", path);
+  if (!plugin_open(p))
+    return -1;
+  while (host->worker_count < PLUGIN_WORKERS && // Started with the first plugin
+         pthread_create(&host->workers[host->worker_count], NULL, plugin_worker, host) == 0)
+    host->worker_count++;
+  if (host->worker_count == 0)
+  {
+    fprintf(stderr, "Couldn't start the plugin workers!\n");
+    plugin_close(p);
+    return -1;
+  }
+  fprintf(stderr, "Plugin %u: %s (%s)\n", host->count, p->api->name != NULL ? p->api->name : "unnamed", path);
+  return (int)host->count++;
+}
+
+// Copies the input into the plugin's job. delta_time is since the plugin's own last call, a plugin that
+// skipped hops (busy or throttled) gets the whole gap; the first call keeps the one of the input.
+static void plugin_prepare(Plugin *p, const CssPluginInput *input)
+{
+  p->input = *input;
+  if (p->last_time > 0.0)
+    p->input.delta_time = (float)(input->time - p->last_time);
+  p->last_time = input->time;
+  p->input.sample_count = input->sample_count < PLUGIN_SAMPLES ? input->sample_count : PLUGIN_SAMPLES;
+  memcpy(p->samples, input->samples + (input->sample_count - p->input.sample_count), p->input.sample_count * sizeof(float));
+  p->input.samples = p->samples;
+  if (input->spectrum_db != NULL)
+  {
+    p->input.bins = input->bins < PLUGIN_BINS ? input->bins : PLUGIN_BINS;
+    memcpy(p->spectrum, input->spectrum_db, p->input.bins * sizeof(float));
+    p->input.spectrum_db = p->spectrum;
+  }
+}
+
+// Render thread, every analysis hop: queues every plugin that isn't busy or throttled with a copy of the input
+void plugin_host_dispatch(PluginHost *host, const CssPluginInput *input)
+{
+  pthread_mutex_lock(&host->lock);
+  for (unsigned int i = 0; i < host->count; i++)
+  {
+    Plugin *p = &host->plugins[i];
+    if (p->busy || input->hop % p->interval != 0)
+    {
+      p->skipped++;
+      continue;
+    }
+    plugin_prepare(p, input);
+    p->busy = true;
+    host->queue[(host->queue_head + host->queued) % PLUGIN_MAX] = i;
+    host->queued++;
+  }
+  pthread_cond_broadcast(&host->wake);
+  pthread_mutex_unlock(&host->lock);
+}
+
+// Render thread: copies the results that came in since the last call into `rows` (PLUGIN_ROW_SIZE per slot)
+// and `values` (PLUGIN_VALUES per slot). Returns how many plugins delivered.
+unsigned int plugin_host_collect(PluginHost *host, float *rows, float *values)
+{
+  unsigned int delivered = 0;
+  pthread_mutex_lock(&host->lock);
+  for (unsigned int i = 0; i < host->count; i++)
+  {
+    Plugin *p = &host->plugins[i];
+    if (!p->done)
+      continue;
+    memcpy(rows + i * PLUGIN_ROW_SIZE, p->row, sizeof(p->row));
+    memcpy(values + i * PLUGIN_VALUES, p->values, sizeof(p->values));
+    p->done = false;
+    delivered++;
+    // Throttled to the budget: a plugin that takes twice the budget runs every other hop
+    unsigned int interval = host->budget_ms > 0.0f && p->avg_ms > host->budget_ms ? (unsigned int)ceilf(p->avg_ms / host->budget_ms) : 1;
+    if (interval > 1 && p->interval == 1)
+      fprintf(stderr, "Plugin %u takes %.2f ms per hop, over the budget of %.2f ms, it runs every %u hops\n", i, p->avg_ms, host->budget_ms, interval);
+    p->interval = interval;
+  }
+  pthread_mutex_unlock(&host->lock);
+  return delivered;
+}
+
+// Render thread, instead of plugin_host_dispatch() and plugin_host_collect() where the results must not depend
+// on timing: calls every plugin on this hop right away, unthrottled, and copies the results into `rows` and
+// `values`. Only for a host nothing was dispatched to (the workers stay idle). The calls are timed apart from
+// the worker ones, their total is in host->run_ms.
+void plugin_host_run(PluginHost *host, const CssPluginInput *input, float *rows, float *values)
+{
+  host->run_ms = 0.0f;
+  for (unsigned int i = 0; i < host->count; i++)
+  {
+    Plugin *p = &host->plugins[i];
+    plugin_prepare(p, input);
+    CssPluginOutput out = {p->row, PLUGIN_ROW_SIZE, p->values, PLUGIN_VALUES};
+    double start = plugin_now();
+    p->api->process(p->state, &p->input, &out);
+    float ms = (float)((plugin_now() - start) * 1000.0);
+    p->run_avg_ms = p->run_count == 0 ? ms : 0.9f * p->run_avg_ms + 0.1f * ms;
+    p->run_max_ms = fmaxf(p->run_max_ms, ms);
+    p->run_count++;
+    host->run_ms += ms;
+    memcpy(rows + i * PLUGIN_ROW_SIZE, p->row, sizeof(p->row));
+    memcpy(values + i * PLUGIN_VALUES, p->values, sizeof(p->values));
+  }
+}
+
+// Render thread: reloads the plugins whose library changed, at most every PLUGIN_POLL seconds
+void plugin_host_poll(PluginHost *host)
+{
+  double now = plugin_now();
+  if (host->count == 0 || now - host->last_poll < PLUGIN_POLL)
+    return;
+  host->last_poll = now;
+  for (unsigned int i = 0; i < host->count; i++)
+  {
+    Plugin *p = &host->plugins[i];
+    PluginStamp stamp = plugin_stamp(p->path);
+    if (stamp.sec == 0 || plugin_stamp_equal(stamp, p->stamp) || (plugin_stamp_equal(stamp, p->failed) && p->retried))
+      continue;
+    pthread_mutex_lock(&host->lock);
+    bool busy = p->busy;
+    pthread_mutex_unlock(&host->lock);
+    if (busy) // Tried again with the next poll, only the render thread queues it
+      continue;
+    if (plugin_open(p))
+      fprintf(stderr, "Reloaded plugin %u: %s\n", i, p->path);
+  }
+}
+
+void plugin_host_reset_stats(PluginHost *host)
+{
+  for (unsigned int i = 0; i < host->count; i++)
+  {
+    host->plugins[i].max_ms = 0.0f;
+    host->plugins[i].run_max_ms = 0.0f;
+  }
+}
+
+// Waits for the running calls, a plugin that never returns blocks this
+void plugin_host_free(PluginHost *host)
+{
+  pthread_mutex_lock(&host->lock);
+  host->stopping = true;
+  pthread_cond_broadcast(&host->wake);
+  pthread_mutex_unlock(&host->lock);
+  for (unsigned int i = 0; i < host->worker_count; i++)
+    pthread_join(host->workers[i], NULL);
+  for (unsigned int i = 0; i < host->count; i++)
+    plugin_close(&host->plugins[i]);
+  pthread_mutex_destroy(&host->lock);
+  pthread_cond_destroy(&host->wake);
+  memset(host, 0, sizeof(*host));
+}
@@ -0,0 +1,199 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Session log of --record, played back headless by --replay. It holds everything the analysis and the drawing
+// depend on: the mono samples as they were pushed into the ring (with the time of the push), the samples a
+// seek wrote over the ring, and per frame the time the analysis ran at and the inputs that changed since the
+// last frame (seeks, canvas size, shader, track, pause). Records are a fixed header and a payload, samples are
+// 16 bit, about 90 KB per second of 44.1 kHz audio.
+// The audio thread must not block on the file, so it only copies its records into a byte ring (single
+// producer, single consumer) and the main thread writes them out before each of its own records, which keeps
+// the log in time order.
+
+#define REPLAY_MAGIC 0x50525343u // "CSRP"
+#define REPLAY_VERSION 1
+#define REPLAY_QUEUE_SIZE (1u << 22) // Bytes of audio records in flight, about 45 s of 44.1 kHz
+#define REPLAY_MAX_PAYLOAD (1u << 20)
+#define REPLAY_FENCE() __sync_synchronize()
+
+typedef enum replay_type_enum
+{
+  REPLAY_AUDIO = 1, // int16 mono samples pushed into the ring
+  REPLAY_REFILL,    // int16 samples that replaced the newest part of the ring (seeking decoded tracks)
+  REPLAY_FRAME,     // float frame time, song time and output latency, a frame was analysed and drawn at `time`
+  REPLAY_SEEK,      // float seconds
+  REPLAY_RESIZE,    // float canvas width and height
+  REPLAY_SHADER,    // uint32 quality tier and the path
+  REPLAY_TRACK,     // float sample rate of the source and the track name
+  REPLAY_PAUSE,     // uint32 paused
+} ReplayType;
+
+typedef struct replay_record_s
+{
+  uint32_t type;
+  uint32_t size; // Payload bytes that follow
+  double time;   // Seconds on the recording clock
+} ReplayRecord;
+
+typedef struct replay_file_header_s
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t buffer_size; // BUFFER_SIZE and NFFT of the recording build, for reference
+  uint32_t nfft;
+} ReplayFileHeader;
+
+typedef struct replay_log_s
+{
+  FILE *file;
+  // Writer, the queue is filled by the audio thread and drained by replay_flush()
+  unsigned char *queue;
+  volatile uint64_t head; // Bytes pushed, only the audio thread writes it
+  volatile uint64_t tail; // Bytes written to the file, only the main thread writes it
+  volatile uint32_t dropped; // Audio records that didn't fit into the queue
+  uint64_t bytes;            // Written to the file
+  // Reader, the last record of replay_next()
+  ReplayRecord record;
+  unsigned char *payload;
+} ReplayLog;
+
+void replay_close(ReplayLog *log)
+{
+  if (log->file != NULL)
+    fclose(log->file);
+  free(log->queue);
+  free(log->payload);
+  memset(log, 0, sizeof(*log));
+}
+
+// Returns 0 on failure
+int replay_create(ReplayLog *log, const char *path, uint32_t buffer_size, uint32_t nfft)
+{
+  memset(log, 0, sizeof(*log));
+  log->file = fopen(path, "wb");
+  log->queue = (unsigned char *)malloc(REPLAY_QUEUE_SIZE);
+  if (log->file == NULL || log->queue == NULL)
+  {
+    fprintf(stderr, "Couldn't create the session log [%s]!\n", path);
+    replay_close(log);
+    return 0;
+  }
+  ReplayFileHeader header = {REPLAY_MAGIC, REPLAY_VERSION, buffer_size, nfft};
+  fwrite(&header, sizeof(header), 1, log->file);
+  log->bytes = sizeof(header);
+  return 1;
+}
+
+static void replay_queue_copy(ReplayLog *log, uint64_t at, const void *data, uint32_t size)
+{
+  uint32_t start = (uint32_t)(at & (REPLAY_QUEUE_SIZE - 1));
+  uint32_t first = REPLAY_QUEUE_SIZE - start < size ? REPLAY_QUEUE_SIZE - start : size;
+  memcpy(log->queue + start, data, first);
+  memcpy(log->queue, (const unsigned char *)data + first, size - first);
+}
+
+static int16_t replay_s16(float sample)
+{
+  float s = sample * 32767.0f;
+  return (int16_t)(s > 32767.0f ? 32767.0f : s < -32767.0f ? -32767.0f : s);
+}
+
+// Audio thread: queues `count` samples (in two pieces, `b` continues `a`, for data that wraps around)
+void replay_push_samples(ReplayLog *log, double time, const float *a, uint32_t a_count, const float *b, uint32_t b_count)
+{
+  ReplayRecord record = {REPLAY_AUDIO, (a_count + b_count) * (uint32_t)sizeof(int16_t), time};
+  uint64_t head = log->head;
+  if (head + sizeof(record) + record.size - log->tail > REPLAY_QUEUE_SIZE)
+  {
+    log->dropped++;
+    return;
+  }
+  replay_queue_copy(log, head, &record, sizeof(record));
+  head += sizeof(record);
+  int16_t chunk[256];
+  for (uint32_t i = 0; i < a_count + b_count;)
+  {
+    uint32_t n = 0;
+    for (; n < 256 && i < a_count + b_count; n++, i++)
+      chunk[n] = replay_s16(i < a_count ? a[i] : b[i - a_count]);
+    replay_queue_copy(log, head, chunk, n * (uint32_t)sizeof(int16_t));
+    head += n * sizeof(int16_t);
+  }
+  REPLAY_FENCE(); // The record is complete before the main thread sees it
+  log->head = head;
+}
+
+// Main thread: writes out what the audio thread queued
+void replay_flush(ReplayLog *log)
+{
+  uint64_t head = log->head;
+  REPLAY_FENCE();
+  uint64_t tail = log->tail;
+  while (tail < head)
+  {
+    uint32_t start = (uint32_t)(tail & (REPLAY_QUEUE_SIZE - 1));
+    uint32_t size = REPLAY_QUEUE_SIZE - start < head - tail ? REPLAY_QUEUE_SIZE - start : (uint32_t)(head - tail);
+    fwrite(log->queue + start, 1, size, log->file);
+    tail += size;
+  }
+  log->bytes += tail - log->tail;
+  REPLAY_FENCE(); // Done with the bytes before the audio thread may overwrite them
+  log->tail = tail;
+}
+
+// Main thread: one record, after everything the audio thread queued so far
+void replay_write(ReplayLog *log, ReplayType type, double time, const void *payload, uint32_t size)
+{
+  replay_flush(log);
+  ReplayRecord record = {type, size, time};
+  fwrite(&record, sizeof(record), 1, log->file);
+  fwrite(payload, 1, size, log->file);
+  log->bytes += sizeof(record) + size;
+}
+
+// Main thread: a record of `count` samples, as int16 like the audio blocks
+void replay_write_samples(ReplayLog *log, ReplayType type, double time, const float *samples, uint32_t count)
+{
+  int16_t *data = (int16_t *)malloc(count * sizeof(int16_t));
+  if (data == NULL)
+    return;
+  for (uint32_t i = 0; i < count; i++)
+    data[i] = replay_s16(samples[i]);
+  replay_write(log, type, time, data, count * (uint32_t)sizeof(int16_t));
+  free(data);
+}
+
+// Returns 0 on failure
+int replay_open(ReplayLog *log, const char *path)
+{
+  memset(log, 0, sizeof(*log));
+  log->file = fopen(path, "rb");
+  log->payload = (unsigned char *)malloc(REPLAY_MAX_PAYLOAD + 1);
+  ReplayFileHeader header = {0};
+  if (log->file == NULL || log->payload == NULL || fread(&header, sizeof(header), 1, log->file) != 1 ||
+      header.magic != REPLAY_MAGIC || header.version != REPLAY_VERSION)
+  {
+    fprintf(stderr, "[%s] isn't a session log (or a different version)!\n", path);
+    replay_close(log);
+    return 0;
+  }
+  return 1;
+}
+
+// Reads the next record into log->record and log->payload (terminated, so paths can be used as they are).
+// Returns 0 at the end of the log or if it's cut off.
+int replay_next(ReplayLog *log)
+{
+  if (fread(&log->record, sizeof(log->record), 1, log->file) != 1)
+    return 0;
+  if (log->record.size > REPLAY_MAX_PAYLOAD || fread(log->payload, 1, log->record.size, log->file) != log->record.size)
+  {
+    fprintf(stderr, "The session log is cut off!\n");
+    return 0;
+  }
+  log->payload[log->record.size] = '\0';
+  return 1;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define DECIMATOR_SSE 1
+#endif
+
+// Polyphase anti-alias resampler that brings the analysis window from whatever rate the stream runs at to
+// a fixed analysis rate, so the FFT only transforms the band we actually show and a bin always means the
+// same frequency. The lowpass is a Blackman windowed sinc with its cutoff just below the lower of the two
+// Nyquist frequencies, tabulated for DECIMATOR_PHASES fractional positions, every output sample is one
+// dot product with the phase closest to where it falls between two input samples (SSE, 4 taps at a time).
+// There is no state between calls, every frame resamples its own window.
+
+#define DECIMATOR_PHASES 256
+#define DECIMATOR_ZERO_CROSSINGS 12 // Per side of the sinc, at the output rate
+#define DECIMATOR_CUTOFF 0.9f       // Of the output Nyquist frequency
+
+typedef struct decimator_s
+{
+  float in_rate;
+  float out_rate;
+  double ratio;       // Input samples per output sample
+  unsigned int taps;  // Per phase, multiple of 4
+  float *table;       // (DECIMATOR_PHASES + 1) * taps, the last phase is the first one shifted by a sample
+} Decimator;
+
+void decimator_free(Decimator *d)
+{
+  free(d->table);
+  memset(d, 0, sizeof(*d));
+}
+
+// Returns 0 on failure. With equal rates the table is a single delta, so it still works (slowly),
+// but decimator_run() just copies in that case.
+int decimator_init(Decimator *d, float in_rate, float out_rate)
+{
+  memset(d, 0, sizeof(*d));
+  d->in_rate = in_rate;
+  d->out_rate = out_rate;
+  d->ratio = (double)in_rate / out_rate;
+  double stretch = d->ratio > 1.0 ? d->ratio : 1.0; // Upsampling keeps the input band, downsampling widens the sinc
+  unsigned int half = (unsigned int)ceil(DECIMATOR_ZERO_CROSSINGS * stretch);
+  d->taps = (2 * half + 3) & ~3u;
+  d->table = (float *)malloc((size_t)(DECIMATOR_PHASES + 1) * d->taps * sizeof(float));
+  if (!d->table)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    decimator_free(d);
+    return 0;
+  }
+  const double pi = 3.14159265358979323846;
+  const double cutoff = DECIMATOR_CUTOFF * 0.5 / stretch; // Cycles per input sample
+  const double center = (double)(d->taps / 2); // Tap that sits on the output position for phase 0
+  for (unsigned int p = 0; p <= DECIMATOR_PHASES; p++)
+  {
+    double frac = (double)p / DECIMATOR_PHASES;
+    float *row = d->table + (size_t)p * d->taps;
+    double sum = 0.0;
+    for (unsigned int t = 0; t < d->taps; t++)
+    {
+      double x = (double)t - center - frac; // Distance from the output position in input samples
+      double sinc = fabs(x) < 1e-9 ? 2.0 * cutoff : sin(2.0 * pi * cutoff * x) / (pi * x);
+      double w = (x + center + 1.0) / (d->taps + 1.0); // Window over the whole span, 0..1
+      double blackman = w <= 0.0 || w >= 1.0 ? 0.0 : 0.42 - 0.5 * cos(2.0 * pi * w) + 0.08 * cos(4.0 * pi * w);
+      row[t] = (float)(sinc * blackman);
+      sum += row[t];
+    }
+    for (unsigned int t = 0; t < d->taps; t++) // Unity gain at DC for every phase
+      row[t] = (float)(row[t] / sum);
+  }
+  return 1;
+}
+
+// Input samples decimator_run() needs for `out_count` outputs
+unsigned int decimator_input_length(const Decimator *d, unsigned int out_count)
+{
+  if (d->ratio == 1.0)
+    return out_count;
+  return (unsigned int)ceil((out_count - 1) * d->ratio) + d->taps + 1;
+}
+
+// Resamples the newest samples of `in` (in_count = decimator_input_length(out_count)) into `out`.
+// The newest output lies taps / 2 input samples before the end of the input, the delay of the filter
+// (none when the rates match).
+void decimator_run(const Decimator *d, const float *in, unsigned int in_count, float *out, unsigned int out_count)
+{
+  if (d->ratio == 1.0)
+  {
+    memcpy(out, in + in_count - out_count, out_count * sizeof(float));
+    return;
+  }
+  const double newest = (double)in_count - 1.0 - (double)(d->taps - d->taps / 2); // Where the newest output lies
+  for (unsigned int m = 0; m < out_count; m++)
+  {
+    // Row p of the table interpolates at taps / 2 + p / PHASES past its first sample
+    double position = newest - (double)(out_count - 1 - m) * d->ratio - (double)(d->taps / 2);
+    long long first = (long long)floor(position);
+    unsigned int phase = (unsigned int)((position - (double)first) * DECIMATOR_PHASES + 0.5);
+    const float *row = d->table + (size_t)phase * d->taps;
+    const float *x = in + first;
+#ifdef DECIMATOR_SSE
+    __m128 acc = _mm_setzero_ps();
+    for (unsigned int t = 0; t < d->taps; t += 4)
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(row + t), _mm_loadu_ps(x + t)));
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    out[m] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+    float acc = 0.0f;
+    for (unsigned int t = 0; t < d->taps; t++)
+      acc += row[t] * x[t];
+    out[m] = acc;
+#endif
+  }
+}
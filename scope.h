@@ -0,0 +1,162 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include "cqt.h" // cplx_fft()
+
+// Trigger stage for the waveform row, so an oscilloscope shader shows a standing trace instead of the
+// last `length` samples jumping around by a random phase every frame.
+// The segment is picked from the newest `length + search` samples, as late as possible:
+// - SCOPE_TRIGGER_EDGE: the newest rising zero crossing with hysteresis (the signal has to go below
+//   -hysteresis first, so noise around zero doesn't retrigger), O(N).
+// - SCOPE_TRIGGER_XCORR: the start that matches the previously published segment best (normalized cross
+//   correlation done with FFTs, O(N log N)), for signals with several crossings per period.
+// Both give a fractional position of the trigger point inside the segment for sub-sample stability.
+
+#define SCOPE_HYSTERESIS 0.1f // Of the peak in the search region
+#define SCOPE_XCORR_SLACK 0.9f // Lags within this much of the best correlation count as a match, the newest wins
+
+typedef enum scope_trigger_enum
+{
+  SCOPE_TRIGGER_NONE = 0,
+  SCOPE_TRIGGER_EDGE,
+  SCOPE_TRIGGER_XCORR,
+  SCOPE_TRIGGER_COUNT,
+} ScopeTrigger;
+
+typedef struct scope_s
+{
+  ScopeTrigger mode;
+  unsigned int length; // Published segment
+  unsigned int search; // How far back the start may move
+  unsigned int fft_size;
+  float *previous;       // Last published segment, length
+  float complex *region; // Scratch for the correlation, fft_size
+  float complex *ref;
+  float *energy; // Prefix sums of the squared region, length + search + 1
+  unsigned int start; // Of the last segment in the samples
+} Scope;
+
+void scope_free(Scope *scope)
+{
+  free(scope->previous);
+  free(scope->region);
+  free(scope->ref);
+  free(scope->energy);
+  ScopeTrigger mode = scope->mode;
+  memset(scope, 0, sizeof(*scope));
+  scope->mode = mode;
+}
+
+// Returns 0 on failure, the scope then just publishes the newest samples
+int scope_init(Scope *scope, unsigned int length, unsigned int search, ScopeTrigger mode)
+{
+  memset(scope, 0, sizeof(*scope));
+  scope->mode = mode;
+  scope->length = length;
+  scope->search = search;
+  for (scope->fft_size = 1; scope->fft_size < 2 * length + search; scope->fft_size <<= 1)
+    ;
+  scope->previous = (float *)calloc(length, sizeof(float));
+  scope->region = (float complex *)malloc(scope->fft_size * sizeof(float complex));
+  scope->ref = (float complex *)malloc(scope->fft_size * sizeof(float complex));
+  scope->energy = (float *)malloc((length + search + 1) * sizeof(float));
+  if (!scope->previous || !scope->region || !scope->ref || !scope->energy)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    scope_free(scope);
+    return 0;
+  }
+  return 1;
+}
+
+// Newest rising crossing at or before `search`, returns -1 if there is none
+static float scope_edge(const Scope *scope, const float *samples)
+{
+  float peak = 0.0f;
+  for (unsigned int i = 0; i < scope->length + scope->search; i++)
+    peak = fmaxf(peak, fabsf(samples[i]));
+  float hysteresis = SCOPE_HYSTERESIS * peak;
+  if (hysteresis <= 0.0f)
+    return -1.0f;
+  float found = -1.0f;
+  int armed = 0;
+  for (unsigned int i = 1; i <= scope->search; i++)
+  {
+    if (samples[i] < -hysteresis)
+      armed = 1;
+    else if (armed && samples[i - 1] < 0.0f && samples[i] >= 0.0f)
+    {
+      found = (float)(i - 1) + samples[i - 1] / (samples[i - 1] - samples[i]); // Where the line crosses zero
+      armed = 0;
+    }
+  }
+  return found;
+}
+
+// Start (with the fraction of the parabola peak) that correlates best with the previous segment, -1 if silent
+static float scope_xcorr(Scope *scope, const float *samples)
+{
+  const unsigned int n = scope->fft_size;
+  const unsigned int total = scope->length + scope->search;
+  for (unsigned int i = 0; i < n; i++)
+  {
+    scope->region[i] = i < total ? samples[i] : 0.0f;
+    scope->ref[i] = i < scope->length ? scope->previous[i] : 0.0f;
+  }
+  cplx_fft(scope->region, n, 0);
+  cplx_fft(scope->ref, n, 0);
+  for (unsigned int i = 0; i < n; i++)
+    scope->region[i] *= conjf(scope->ref[i]);
+  cplx_fft(scope->region, n, 1); // region[lag] is now n times the correlation at lag
+
+  scope->energy[0] = 0.0f;
+  for (unsigned int i = 0; i < total; i++)
+    scope->energy[i + 1] = scope->energy[i] + samples[i] * samples[i];
+  float best = 0.0f;
+  for (unsigned int lag = 0; lag <= scope->search; lag++)
+  {
+    float e = scope->energy[lag + scope->length] - scope->energy[lag];
+    float c = e > 0.0f ? crealf(scope->region[lag]) / sqrtf(e) : 0.0f;
+    scope->energy[lag] = c; // Reused for the normalized correlation, the prefix sums before lag aren't needed anymore
+    best = fmaxf(best, c);
+  }
+  if (best <= 0.0f)
+    return -1.0f;
+  for (unsigned int lag = scope->search + 1; lag-- > 0;)
+  {
+    if (scope->energy[lag] < SCOPE_XCORR_SLACK * best)
+      continue;
+    // Climb to the local peak and refine it
+    while (lag > 0 && scope->energy[lag - 1] > scope->energy[lag])
+      lag--;
+    if (lag == 0 || lag == scope->search)
+      return (float)lag;
+    float a = scope->energy[lag - 1], b = scope->energy[lag], c = scope->energy[lag + 1];
+    float denom = a - 2.0f * b + c;
+    return (float)lag + (denom < 0.0f ? 0.5f * (a - c) / denom : 0.0f);
+  }
+  return -1.0f;
+}
+
+// `samples` are the newest length + search samples, copies the triggered segment into `out` and returns
+// where the trigger point lies in it (0..1 samples, the fraction the shader can shift the trace by)
+float scope_trigger(Scope *scope, const float *samples, float *out)
+{
+  float position = -1.0f;
+  if (scope->previous != NULL && scope->mode == SCOPE_TRIGGER_EDGE)
+    position = scope_edge(scope, samples);
+  else if (scope->previous != NULL && scope->mode == SCOPE_TRIGGER_XCORR)
+    position = scope_xcorr(scope, samples);
+  if (position < 0.0f) // Untriggered, free running like a scope in auto mode
+    position = (float)scope->search;
+  scope->start = (unsigned int)position;
+  if (scope->start > scope->search)
+    scope->start = scope->search;
+  memcpy(out, samples + scope->start, scope->length * sizeof(float));
+  if (scope->previous != NULL)
+    memcpy(scope->previous, out, scope->length * sizeof(float));
+  return position - (float)scope->start;
+}
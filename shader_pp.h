@@ -0,0 +1,265 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raylib.h"
+
+// Host side preprocessing of the visual shaders, before they're handed to the GLSL compiler:
+// - `#include "file"` is replaced by the file, looked up next to the including file first and then in
+//   SHADER_LIB_DIR (`#include <file>` only looks there). Every file is pasted once however often it's
+//   included, so library files can include each other. #if isn't evaluated here, an include in a disabled
+//   branch still gets pasted (and is disabled along with the branch).
+// - The caller's prelude (host constants, the uFrame block) goes right after the #version line.
+// #line directives keep the compiler errors pointing at the right line. The source string number tells the
+// files apart: 0 is the shader itself, the includes are numbered in the order they're pasted and listed on
+// stderr when the shader is loaded.
+// Reading and expanding (shader_source_load) is separate from putting the prelude in (shader_source_assemble),
+// so the files are read once for all the variants of a shader. The loading doesn't touch GL or raylib's static
+// buffers, it can run on a worker thread.
+
+#define SHADER_LIB_DIR "shaders/lib"
+#define SHADER_MAX_INCLUDES 32
+#define SHADER_MAX_PATH 512
+
+typedef struct shader_pp_s
+{
+  char *data; // The output, always terminated
+  size_t length;
+  size_t capacity;
+  int failed;
+  unsigned int files; // In paths, 0 is the shader
+  char paths[SHADER_MAX_INCLUDES + 1][SHADER_MAX_PATH];
+} ShaderPP;
+
+static void shader_pp_expand(ShaderPP *pp, const char *source, unsigned int file, unsigned int line);
+
+static void shader_pp_append(ShaderPP *pp, const char *text, size_t length)
+{
+  if (pp->failed)
+    return;
+  if (pp->length + length + 1 > pp->capacity)
+  {
+    size_t capacity = pp->capacity > 0 ? pp->capacity : 4096;
+    while (capacity < pp->length + length + 1)
+      capacity *= 2;
+    char *data = (char *)realloc(pp->data, capacity);
+    if (!data)
+    {
+      fprintf(stderr, "ERROR: Memory allocation failed\n");
+      pp->failed = 1;
+      return;
+    }
+    pp->data = data;
+    pp->capacity = capacity;
+  }
+  memcpy(pp->data + pp->length, text, length);
+  pp->length += length;
+  pp->data[pp->length] = '\0';
+}
+
+// What follows is line `line` of file `file`
+static void shader_pp_line(ShaderPP *pp, unsigned int line, unsigned int file)
+{
+  char directive[48];
+  int length = snprintf(directive, sizeof(directive), "#line %u %u\n", line, file);
+  shader_pp_append(pp, directive, (size_t)length);
+}
+
+static void shader_pp_end_line(ShaderPP *pp)
+{
+  if (pp->length > 0 && pp->data[pp->length - 1] != '\n')
+    shader_pp_append(pp, "\n", 1);
+}
+
+// Returns 1 if [line, end) is an #include, with the name copied into `name` and `system` set for <name>
+static int shader_pp_parse_include(const char *line, const char *end, char *name, size_t size, int *system)
+{
+  const char *c = line;
+  while (c < end && (*c == ' ' || *c == '\t'))
+    c++;
+  if (c == end || *c != '#')
+    return 0;
+  c++;
+  while (c < end && (*c == ' ' || *c == '\t'))
+    c++;
+  if (end - c < 7 || strncmp(c, "include", 7) != 0)
+    return 0;
+  c += 7;
+  while (c < end && (*c == ' ' || *c == '\t'))
+    c++;
+  if (c == end || (*c != '"' && *c != '<'))
+    return 0; // Left to the compiler, which will complain about it
+  char close = *c == '"' ? '"' : '>';
+  *system = *c == '<';
+  const char *start = ++c;
+  while (c < end && *c != close)
+    c++;
+  if (c == end || c == start || (size_t)(c - start) >= size)
+    return 0;
+  memcpy(name, start, (size_t)(c - start));
+  name[c - start] = '\0';
+  return 1;
+}
+
+static void shader_pp_include(ShaderPP *pp, unsigned int from, const char *name, int system)
+{
+  char path[SHADER_MAX_PATH];
+  int found = 0;
+  if (!system)
+  {
+    const char *dir = pp->paths[from];
+    const char *slash = strrchr(dir, '/');
+    if (slash == NULL)
+      slash = strrchr(dir, '\\');
+    if (slash != NULL) // Not GetDirectoryPath(), its buffer is shared by all threads
+      snprintf(path, sizeof(path), "%.*s/%s", (int)(slash - dir), dir, name);
+    else
+      snprintf(path, sizeof(path), "%s", name);
+    found = FileExists(path);
+  }
+  if (!found)
+  {
+    snprintf(path, sizeof(path), "%s/%s", SHADER_LIB_DIR, name);
+    found = FileExists(path);
+  }
+  if (!found)
+  {
+    fprintf(stderr, "Couldn't find [%s] included by [%s]!\n", name, GetFileName(pp->paths[from]));
+    pp->failed = 1;
+    return;
+  }
+  for (unsigned int i = 0; i < pp->files; i++)
+  {
+    if (strcmp(pp->paths[i], path) == 0) // Already pasted
+      return;
+  }
+  if (pp->files > SHADER_MAX_INCLUDES)
+  {
+    fprintf(stderr, "Too many includes in [%s]!\n", GetFileName(pp->paths[0]));
+    pp->failed = 1;
+    return;
+  }
+  char *source = LoadFileText(path);
+  if (!source)
+  {
+    pp->failed = 1;
+    return;
+  }
+  unsigned int file = pp->files++;
+  strcpy(pp->paths[file], path);
+  shader_pp_line(pp, 1, file);
+  shader_pp_expand(pp, source, file, 1);
+  shader_pp_end_line(pp);
+  UnloadFileText(source);
+}
+
+// Appends `source`, which starts at line `line` of file `file`, with its includes expanded
+static void shader_pp_expand(ShaderPP *pp, const char *source, unsigned int file, unsigned int line)
+{
+  const char *c = source;
+  while (*c != '\0' && !pp->failed)
+  {
+    const char *end = strchr(c, '\n');
+    if (end == NULL)
+      end = c + strlen(c);
+    char name[SHADER_MAX_PATH];
+    int system = 0;
+    if (shader_pp_parse_include(c, end, name, sizeof(name), &system))
+    {
+      shader_pp_include(pp, file, name, system);
+      shader_pp_line(pp, line + 1, file);
+    }
+    else
+    {
+      shader_pp_append(pp, c, (size_t)(end - c) + (*end == '\n'));
+    }
+    line++;
+    c = *end == '\n' ? end + 1 : end;
+  }
+}
+
+typedef struct shader_source_s
+{
+  char path[SHADER_MAX_PATH];
+  char *head; // Everything up to and including the #version line
+  char *body; // The rest with the includes pasted, starts with a #line directive
+} ShaderSource;
+
+void shader_source_free(ShaderSource *s)
+{
+  free(s->head);
+  free(s->body);
+  memset(s, 0, sizeof(*s));
+}
+
+// Reads the shader at `path` and pastes its includes. Returns 0 if it or one of its includes couldn't be read.
+int shader_source_load(ShaderSource *s, const char *path)
+{
+  memset(s, 0, sizeof(*s));
+  char *source = LoadFileText(path);
+  if (!source)
+    return 0;
+  ShaderPP *pp = (ShaderPP *)calloc(1, sizeof(ShaderPP));
+  if (!pp)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    UnloadFileText(source);
+    return 0;
+  }
+  snprintf(pp->paths[0], SHADER_MAX_PATH, "%s", path);
+  pp->files = 1;
+
+  // Everything up to the #version line (comments) and the line itself stays on top, it has to come first
+  const char *body = source;
+  unsigned int line = 1;
+  const char *version = strstr(source, "#version");
+  if (version != NULL)
+  {
+    const char *end = strchr(version, '\n');
+    body = end != NULL ? end + 1 : version + strlen(version);
+    for (const char *c = source; c < body; c++)
+      line += *c == '\n';
+  }
+  shader_pp_append(pp, source, (size_t)(body - source));
+  shader_pp_end_line(pp);
+  s->head = pp->data;
+  pp->data = NULL;
+  pp->length = pp->capacity = 0;
+  shader_pp_line(pp, line, 0);
+  shader_pp_expand(pp, body, 0, line);
+  s->body = pp->data;
+  UnloadFileText(source);
+
+  for (unsigned int i = 1; i < pp->files && !pp->failed; i++)
+    fprintf(stderr, "  source %u: %s\n", i, pp->paths[i]);
+  int failed = pp->failed || s->head == NULL || s->body == NULL;
+  free(pp);
+  if (failed)
+  {
+    shader_source_free(s);
+    return 0;
+  }
+  snprintf(s->path, SHADER_MAX_PATH, "%s", path);
+  return 1;
+}
+
+// The loaded source with `prelude` after its #version line, ready for LoadShaderFromMemory() (malloc'd).
+// NULL if there is no source.
+char *shader_source_assemble(const ShaderSource *s, const char *prelude)
+{
+  if (s->head == NULL || s->body == NULL)
+    return NULL;
+  size_t head = strlen(s->head), length = strlen(prelude), body = strlen(s->body);
+  char *out = (char *)malloc(head + length + 1 + body + 1);
+  if (!out)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    return NULL;
+  }
+  memcpy(out, s->head, head);
+  memcpy(out + head, prelude, length);
+  if (length > 0 && prelude[length - 1] != '\n')
+    out[head + length++] = '\n';
+  memcpy(out + head + length, s->body, body + 1);
+  return out;
+}
@@ -0,0 +1,20 @@
+// Lookups into the textures the host binds, `#include "audio.glsl"` after the uniform declarations.
+// BUFFER_SIZE, NFFT and ANALYSIS_RATE are defined by the host.
+
+// Spectrum at texel `texel` of uBuffer (0 .. BUFFER_SIZE), bilinearly filtered
+float spectrum_texel ( sampler2D tex, float texel )
+{
+    return texture ( tex, vec2 ( texel / float ( BUFFER_SIZE ), 0.0 ) ).x;
+}
+
+// Spectrum at `hz` (0 .. ANALYSIS_RATE / 2)
+float spectrum_hz ( sampler2D tex, float hz )
+{
+    return spectrum_texel ( tex, hz * float ( NFFT ) / ANALYSIS_RATE );
+}
+
+// Waveform at `x` (0..1 over the BUFFER_SIZE samples), -1..1
+float waveform ( sampler2D tex, float x )
+{
+    return texture ( tex, vec2 ( x, 0.0 ) ).y * 2.0 - 1.0;
+}
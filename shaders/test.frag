@@ -8,6 +8,8 @@ uniform vec2 uResolution;
 uniform float uTime;
 uniform sampler2D uBuffer;
 
+#include "audio.glsl"
+
 float sq ( float value )
 {
     return value * value;
@@ -15,7 +17,7 @@ float sq ( float value )
 
 float get_amp ( float frequency )
 {
-    return texture ( uBuffer, vec2 ( frequency / 2048.0, 0 ) ).x;
+    return spectrum_texel ( uBuffer, frequency );
 }
 
 float get_weight ( float f )
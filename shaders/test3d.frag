@@ -1,5 +1,11 @@
 #version 330
+#if QUALITY == QUALITY_LOW
+#define MAX_STEPS 32
+#elif QUALITY == QUALITY_MEDIUM
+#define MAX_STEPS 56
+#else
 #define MAX_STEPS 80
+#endif
 #define MAX_DIST 100.0
 #define MIN_DIST 0.001
 
@@ -46,12 +52,12 @@ float map(vec3 p) {
 float raymarch(vec3 ro, vec3 rd) {
     float t = 0.0; // distance traveled
 
-    for(int i = 0; i < 80; i++) {
+    for(int i = 0; i < MAX_STEPS; i++) {
         vec3 p = ro + rd * t;
         float d = map(p);
         t += d;
 
-        if(d < 0.001 || t > 100.0)
+        if(d < MIN_DIST || t > MAX_DIST)
             break;
     }
     return t;
@@ -0,0 +1,205 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "external/jar_xm.h" // raylib's module players, only the declarations, raudio.c has the implementation
+#include "external/jar_mod.h"
+
+// Per channel state of tracker modules (.xm/.mod). raylib only hands out the mixed output, so a second
+// player of the same module runs in lockstep with the stream on the audio thread: every frame the stream
+// processor gets is rendered by it too (into scratch, that's the extra mixing), and every TRACKER_SLICE
+// frames the state of its channels is recorded: level (volume with envelopes), note and a note-on counter.
+// On top of the mixing that is O(channels) per slice, so the cost stays bounded for 32 channel modules.
+// The main thread looks up the snapshot at the audible position, the same one the analysis window ends at.
+
+#define TRACKER_MAX_CHANNELS 32
+#define TRACKER_SLICE 64      // Frames between two snapshots
+#define TRACKER_HISTORY 1024  // Snapshots kept, covers 65536 frames of output latency
+#define TRACKER_C4_RATE 8363.0f // Playback rate of a sample at C-4, MIDI note 60
+#define TRACKER_AMIGA_CLOCK 3546894.6f // PAL Paula clock, rate = clock / period
+
+typedef enum tracker_kind_enum
+{
+  TRACKER_NONE = 0,
+  TRACKER_XM,
+  TRACKER_MOD,
+} TrackerKind;
+
+typedef struct tracker_snapshot_s
+{
+  unsigned long long position;         // Stream position (the caller's frame count) the snapshot was taken at
+  float level[TRACKER_MAX_CHANNELS];   // 0..1
+  float note[TRACKER_MAX_CHANNELS];    // MIDI note number with fraction, 0 if the channel is silent
+  unsigned int triggers[TRACKER_MAX_CHANNELS]; // Note-ons so far, a change means a new note
+} TrackerSnapshot;
+
+typedef struct tracker_s
+{
+  TrackerKind kind;
+  unsigned int channels;
+  unsigned int sample_rate;
+  jar_xm_context_t *xm;
+  jar_mod_context_t *mod;
+  // Only touched by the audio thread
+  float scratch[2 * TRACKER_SLICE]; // The rendered frames nobody listens to (the MOD player writes shorts)
+  unsigned long long rendered;
+  unsigned long long last_trigger[TRACKER_MAX_CHANNELS]; // XM: sample count of the latest note-on
+  unsigned long last_position[TRACKER_MAX_CHANNELS];     // MOD: sample position
+  unsigned int triggers[TRACKER_MAX_CHANNELS];
+  TrackerSnapshot *history;
+  volatile unsigned long long snapshots; // Written so far
+  volatile int reset_requested;          // Set by the main thread when the stream restarts the module
+} Tracker;
+
+void tracker_free(Tracker *t)
+{
+  if (t->xm)
+    jar_xm_free_context(t->xm);
+  if (t->mod)
+  {
+    jar_mod_unload(t->mod);
+    free(t->mod);
+  }
+  free(t->history);
+  memset(t, 0, sizeof(*t));
+}
+
+// Opens the module at `path` for a stream at `sample_rate`, returns 0 if it isn't one or can't be loaded
+int tracker_init(Tracker *t, const char *path, unsigned int sample_rate)
+{
+  memset(t, 0, sizeof(*t));
+  t->sample_rate = sample_rate;
+  const char *ext = strrchr(path, '.');
+  if (ext != NULL && (strcmp(ext, ".xm") == 0 || strcmp(ext, ".XM") == 0))
+  {
+    if (jar_xm_create_context_from_file(&t->xm, sample_rate, path) != 0)
+    {
+      t->xm = NULL;
+      fprintf(stderr, "Couldn't open [%s] for the channel analysis!\n", path);
+      return 0;
+    }
+    jar_xm_set_max_loop_count(t->xm, 0); // Same as raylib, the stream decides when the track ends
+    t->kind = TRACKER_XM;
+    t->channels = jar_xm_get_number_of_channels(t->xm);
+  }
+  else if (ext != NULL && (strcmp(ext, ".mod") == 0 || strcmp(ext, ".MOD") == 0))
+  {
+    t->mod = (jar_mod_context_t *)calloc(1, sizeof(jar_mod_context_t));
+    if (!t->mod)
+    {
+      fprintf(stderr, "ERROR: Memory allocation failed\n");
+      return 0;
+    }
+    jar_mod_init(t->mod);
+    jar_mod_setcfg(t->mod, (int)sample_rate, 16, 1, 128, 0);
+    if (jar_mod_load_file(t->mod, path) == 0)
+    {
+      fprintf(stderr, "Couldn't open [%s] for the channel analysis!\n", path);
+      tracker_free(t);
+      return 0;
+    }
+    t->kind = TRACKER_MOD;
+    t->channels = t->mod->number_of_channels;
+  }
+  else
+  {
+    return 0;
+  }
+  if (t->channels > TRACKER_MAX_CHANNELS)
+    t->channels = TRACKER_MAX_CHANNELS;
+  t->history = (TrackerSnapshot *)calloc(TRACKER_HISTORY, sizeof(TrackerSnapshot));
+  if (!t->history)
+  {
+    fprintf(stderr, "ERROR: Memory allocation failed\n");
+    tracker_free(t);
+    return 0;
+  }
+  return 1;
+}
+
+static void tracker_snapshot(Tracker *t, unsigned long long position)
+{
+  TrackerSnapshot *s = &t->history[t->snapshots % TRACKER_HISTORY];
+  s->position = position;
+  for (unsigned int c = 0; c < t->channels; c++)
+  {
+    float level = 0.0f, rate = 0.0f;
+    if (t->kind == TRACKER_XM)
+    {
+      unsigned short chn = (unsigned short)(c + 1); // jar_xm counts channels from 1
+      unsigned long long trigger = jar_xm_get_latest_trigger_of_channel(t->xm, chn);
+      if (trigger != t->last_trigger[c])
+      {
+        t->last_trigger[c] = trigger;
+        t->triggers[c]++;
+      }
+      if (jar_xm_is_channel_active(t->xm, chn))
+      {
+        level = jar_xm_get_volume_of_channel(t->xm, chn);
+        rate = jar_xm_get_frequency_of_channel(t->xm, chn);
+      }
+    }
+    else
+    {
+      const channel *ch = &t->mod->channels[c];
+      if (ch->samppos < t->last_position[c]) // Restarted, a sample that loops from its start counts as well
+        t->triggers[c]++;
+      if (ch->sampdata != NULL && ch->period != 0 && ch->samppos != t->last_position[c]) // Still moving
+      {
+        level = ch->volume / 64.0f;
+        rate = TRACKER_AMIGA_CLOCK / (float)ch->period;
+      }
+      t->last_position[c] = ch->samppos;
+    }
+    s->level[c] = level;
+    s->note[c] = level > 0.0f && rate > 0.0f ? 60.0f + 12.0f * log2f(rate / TRACKER_C4_RATE) : 0.0f;
+    s->triggers[c] = t->triggers[c];
+  }
+  t->snapshots++; // Published after the snapshot is complete
+}
+
+// Audio thread: advances the module by the `frames` the stream just played, `position` is where the first
+// one of them lies in the caller's frame count (the snapshots are looked up by it)
+void tracker_process(Tracker *t, unsigned int frames, unsigned long long position)
+{
+  if (t->reset_requested) // The stream started the module over (raylib resets its player when it stops)
+  {
+    if (t->kind == TRACKER_XM)
+      jar_xm_reset(t->xm);
+    else
+      jar_mod_seek_start(t->mod);
+    t->reset_requested = 0;
+  }
+  while (frames > 0)
+  {
+    // The slices are kept on the same grid across calls, so the snapshots are exactly TRACKER_SLICE apart
+    unsigned int n = TRACKER_SLICE - (unsigned int)(t->rendered % TRACKER_SLICE);
+    if (n > frames)
+      n = frames;
+    if (t->kind == TRACKER_XM)
+      jar_xm_generate_samples(t->xm, t->scratch, n);
+    else
+      jar_mod_fillbuffer(t->mod, (short *)t->scratch, n, NULL);
+    t->rendered += n;
+    position += n;
+    frames -= n;
+    if (t->rendered % TRACKER_SLICE == 0)
+      tracker_snapshot(t, position);
+  }
+}
+
+// Main thread: the newest snapshot at or before `position`, NULL if there is none that old or none yet
+const TrackerSnapshot *tracker_snapshot_at(const Tracker *t, unsigned long long position)
+{
+  unsigned long long count = t->snapshots;
+  if (count == 0)
+    return NULL;
+  const TrackerSnapshot *newest = &t->history[(count - 1) % TRACKER_HISTORY];
+  if (newest->position <= position)
+    return newest;
+  unsigned long long back = (newest->position - position + TRACKER_SLICE - 1) / TRACKER_SLICE;
+  if (back >= count || back >= TRACKER_HISTORY - TRACKER_HISTORY / 4) // Keep away from the one being overwritten
+    return NULL;
+  return &t->history[(count - 1 - back) % TRACKER_HISTORY];
+}